@@ -0,0 +1,216 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "accounting.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMPTY_KEY UINT64_MAX
+
+struct entry {
+    uint64_t key;  /* EMPTY_KEY until claimed. Never changes after that. */
+    uint64_t ops;
+    uint64_t time_ns;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t padding[3];  /* One entry per cache line. */
+};
+
+/* Slots in each shard that only per-user entries may claim, so that a
+   shard full of processes still has room for their users' entries. */
+#define RESERVED_PER_SHARD 8
+
+static struct entry *table = NULL;  /* ACCOUNTING_SHARDS * ACCOUNTING_SHARD_SIZE */
+static unsigned int shard_used[ACCOUNTING_SHARDS];
+static struct entry overflow;
+
+static uint64_t make_key(uint32_t uid, uint32_t pid)
+{
+    return ((uint64_t)uid << 32) | pid;
+}
+
+static uint64_t hash_key(uint64_t x)
+{
+    /* The splitmix64 finalizer. */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Returns NULL if there is no room for `key` among the first `max_used`
+   slots of its shard. */
+static struct entry *find_entry_by_key(uint64_t key, unsigned int max_used)
+{
+    if (key == EMPTY_KEY) {
+        return NULL;
+    }
+    uint64_t h = hash_key(key);
+    unsigned int *used = &shard_used[h % ACCOUNTING_SHARDS];
+    struct entry *shard = &table[(h % ACCOUNTING_SHARDS) * ACCOUNTING_SHARD_SIZE];
+    unsigned int start = (unsigned int)((h / ACCOUNTING_SHARDS) % ACCOUNTING_SHARD_SIZE);
+
+    /* Entries are never removed, so if the key exists, it's before the
+       first free slot. */
+    for (unsigned int i = 0; i < ACCOUNTING_SHARD_SIZE; ++i) {
+        struct entry *e = &shard[(start + i) % ACCOUNTING_SHARD_SIZE];
+        uint64_t k = __atomic_load_n(&e->key, __ATOMIC_RELAXED);
+        if (k == EMPTY_KEY) {
+            if (__atomic_add_fetch(used, 1, __ATOMIC_RELAXED) > max_used) {
+                __atomic_sub_fetch(used, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+            uint64_t expected = EMPTY_KEY;
+            if (__atomic_compare_exchange_n(&e->key, &expected, key, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return e;
+            }
+            __atomic_sub_fetch(used, 1, __ATOMIC_RELAXED);
+            k = expected;  /* Another thread claimed it first. */
+        }
+        if (k == key) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static struct entry *find_entry(uint32_t uid, uint32_t pid)
+{
+    struct entry *e;
+    if (pid == 0) {
+        e = find_entry_by_key(make_key(uid, 0), ACCOUNTING_SHARD_SIZE);
+    } else {
+        e = find_entry_by_key(make_key(uid, pid), ACCOUNTING_SHARD_SIZE - RESERVED_PER_SHARD);
+        if (e == NULL) {
+            /* Keep counting per user when there's no room for the process. */
+            e = find_entry_by_key(make_key(uid, ACCOUNTING_OTHER_PIDS), ACCOUNTING_SHARD_SIZE);
+        }
+    }
+    return e != NULL ? e : &overflow;
+}
+
+int accounting_init(void)
+{
+    size_t n = ACCOUNTING_SHARDS * ACCOUNTING_SHARD_SIZE;
+    table = calloc(n, sizeof(struct entry));
+    if (table == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        table[i].key = EMPTY_KEY;
+    }
+    memset(shard_used, 0, sizeof(shard_used));
+    memset(&overflow, 0, sizeof(overflow));
+    return 0;
+}
+
+void accounting_record_op(uint32_t uid, uint32_t pid, double seconds)
+{
+    struct entry *e = find_entry(uid, pid);
+    __atomic_fetch_add(&e->ops, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->time_ns, (uint64_t)(seconds * 1e9), __ATOMIC_RELAXED);
+}
+
+void accounting_add_bytes(uint32_t uid, uint32_t pid,
+                          uint64_t bytes_read, uint64_t bytes_written)
+{
+    struct entry *e = find_entry(uid, pid);
+    if (bytes_read > 0) {
+        __atomic_fetch_add(&e->bytes_read, bytes_read, __ATOMIC_RELAXED);
+    }
+    if (bytes_written > 0) {
+        __atomic_fetch_add(&e->bytes_written, bytes_written, __ATOMIC_RELAXED);
+    }
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    uint64_t ka = ((const struct entry *)a)->key;
+    uint64_t kb = ((const struct entry *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static void print_entry(FILE *f, const struct entry *e, int by_pid, const char *label)
+{
+    if (label != NULL) {
+        fprintf(f, by_pid ? "%-10s %10s " : "%-10s ", label, "");
+    } else if (by_pid && (uint32_t)e->key == ACCOUNTING_OTHER_PIDS) {
+        fprintf(f, "%-10u %10s ", (unsigned int)(e->key >> 32), "other");
+    } else if (by_pid) {
+        fprintf(f, "%-10u %10u ", (unsigned int)(e->key >> 32), (unsigned int)(e->key & 0xffffffff));
+    } else {
+        fprintf(f, "%-10u ", (unsigned int)(e->key >> 32));
+    }
+    fprintf(f, "%12llu %12.1f %16llu %16llu\n",
+            (unsigned long long)e->ops, e->time_ns / 1e6,
+            (unsigned long long)e->bytes_read, (unsigned long long)e->bytes_written);
+}
+
+/* Copies the counters of `src`, which other threads may be updating. */
+static void load_entry(struct entry *dst, const struct entry *src)
+{
+    dst->key = __atomic_load_n(&src->key, __ATOMIC_RELAXED);
+    dst->ops = __atomic_load_n(&src->ops, __ATOMIC_RELAXED);
+    dst->time_ns = __atomic_load_n(&src->time_ns, __ATOMIC_RELAXED);
+    dst->bytes_read = __atomic_load_n(&src->bytes_read, __ATOMIC_RELAXED);
+    dst->bytes_written = __atomic_load_n(&src->bytes_written, __ATOMIC_RELAXED);
+}
+
+void accounting_print(FILE *f, int by_pid)
+{
+    size_t n = ACCOUNTING_SHARDS * ACCOUNTING_SHARD_SIZE;
+    struct entry *copy = malloc(n * sizeof(struct entry));
+    if (copy == NULL) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        load_entry(&copy[count], &table[i]);
+        if (copy[count].key != EMPTY_KEY) {
+            ++count;
+        }
+    }
+    qsort(copy, count, sizeof(struct entry), compare_entries);
+
+    if (by_pid) {
+        fprintf(f, "%-10s %10s ", "uid", "pid");
+    } else {
+        fprintf(f, "%-10s ", "uid");
+    }
+    fprintf(f, "%12s %12s %16s %16s\n", "ops", "time_ms", "bytes_read", "bytes_written");
+    for (size_t i = 0; i < count; ++i) {
+        print_entry(f, &copy[i], by_pid, NULL);
+    }
+    struct entry other;
+    load_entry(&other, &overflow);
+    if (other.ops > 0 || other.bytes_read > 0 || other.bytes_written > 0) {
+        print_entry(f, &other, by_pid, "other");
+    }
+    free(copy);
+}
+
+void accounting_free(void)
+{
+    free(table);
+    table = NULL;
+}
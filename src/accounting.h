@@ -0,0 +1,52 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_ACCOUNTING_H
+#define INC_BINDFS_ACCOUNTING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Operations, time and bytes per user, or per user and process.
+ *
+ * Entries live in a fixed-size hash table split into shards. A key is
+ * looked up only within its shard, and new entries claim a free slot with
+ * compare-and-swap, so recording takes no locks. Entries are never removed.
+ * When a process has no room in its shard, it is counted in a per-user
+ * entry for other processes instead, and when that has no room either,
+ * in a single overflow entry. */
+
+#define ACCOUNTING_SHARDS 64
+#define ACCOUNTING_SHARD_SIZE 64
+
+/* The pid of the per-user entry for processes that didn't fit. */
+#define ACCOUNTING_OTHER_PIDS UINT32_MAX
+
+/* Allocates the table. Returns -1 and sets errno on error. */
+int accounting_init(void);
+/* Records an operation by `uid` in process `pid` that took `seconds`.
+   Pass 0 as `pid` to account per user only. */
+void accounting_record_op(uint32_t uid, uint32_t pid, double seconds);
+void accounting_add_bytes(uint32_t uid, uint32_t pid,
+                          uint64_t bytes_read, uint64_t bytes_written);
+/* Prints a table of the entries sorted by uid and pid. */
+void accounting_print(FILE *f, int by_pid);
+void accounting_free(void);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "adaptive_limiter.h"
+#include "histogram.h"
+#include "rate_limiter.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WINDOW_SECONDS 1.0
+/* Fewer samples than this say little about the p99. The window is extended. */
+#define MIN_SAMPLES 16
+#define DECREASE_FACTOR 0.5
+/* After a decrease, the rate grows by this fraction of the new rate per window. */
+#define INCREASE_FRACTION 0.1
+/* Limiting stops when the rate exceeds the throughput by this factor. */
+#define LIFT_FACTOR 2.0
+
+struct AdaptiveLimiter {
+    RateLimiter limiter;
+    double target_latency;
+    double min_rate;
+    double step;
+    int limiting;
+
+    /* The current window, updated with atomics. */
+    double window_start;
+    uint64_t samples;
+    uint64_t bytes;
+    unsigned long long counts[HISTOGRAM_BUCKETS];
+
+    pthread_mutex_t adjust_lock;
+};
+
+AdaptiveLimiter *adaptive_limiter_create(double target_latency, double min_rate,
+                                         double (*clock)(void))
+{
+    AdaptiveLimiter *al = calloc(1, sizeof(AdaptiveLimiter));
+    rate_limiter_init(&al->limiter, min_rate, clock);
+    al->target_latency = target_latency;
+    al->min_rate = min_rate;
+    al->step = min_rate;
+    al->limiting = 0;
+    al->window_start = clock();
+    pthread_mutex_init(&al->adjust_lock, NULL);
+    return al;
+}
+
+double adaptive_limiter_wait_nosleep(AdaptiveLimiter *al, size_t size)
+{
+    if (!__atomic_load_n(&al->limiting, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return rate_limiter_wait_nosleep(&al->limiter, size);
+}
+
+/* Ends the window. Called with adjust_lock held. */
+static void adjust(AdaptiveLimiter *al, double now)
+{
+    uint64_t samples = __atomic_load_n(&al->samples, __ATOMIC_RELAXED);
+    if (samples < MIN_SAMPLES) {
+        return;
+    }
+
+    unsigned long long counts[HISTOGRAM_BUCKETS];
+    unsigned long long total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        counts[i] = __atomic_exchange_n(&al->counts[i], 0, __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+    uint64_t bytes = __atomic_exchange_n(&al->bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&al->samples, 0, __ATOMIC_RELAXED);
+    double elapsed = now - al->window_start;
+    __atomic_store(&al->window_start, &now, __ATOMIC_RELAXED);
+
+    double p99 = histogram_percentile(counts, total, 0.99);
+    double throughput = bytes / elapsed;
+    double rate = rate_limiter_get_rate(&al->limiter);
+    int limiting = al->limiting;
+
+    if (p99 > al->target_latency) {
+        if (!limiting || throughput < rate) {
+            rate = throughput;
+        }
+        rate *= DECREASE_FACTOR;
+        if (rate < al->min_rate) {
+            rate = al->min_rate;
+        }
+        al->step = rate * INCREASE_FRACTION;
+        if (al->step < al->min_rate) {
+            al->step = al->min_rate;
+        }
+        limiting = 1;
+    } else if (limiting) {
+        rate += al->step;
+        if (rate > throughput * LIFT_FACTOR) {
+            limiting = 0;
+        }
+    }
+
+    rate_limiter_set_rate(&al->limiter, rate);
+    __atomic_store_n(&al->limiting, limiting, __ATOMIC_RELAXED);
+}
+
+void adaptive_limiter_record(AdaptiveLimiter *al, double latency, size_t size)
+{
+    __atomic_fetch_add(&al->counts[histogram_bucket(latency)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&al->bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&al->samples, 1, __ATOMIC_RELAXED);
+
+    double now = al->limiter.clock();
+    double window_start;
+    __atomic_load(&al->window_start, &window_start, __ATOMIC_RELAXED);
+    if (now - window_start >= WINDOW_SECONDS && pthread_mutex_trylock(&al->adjust_lock) == 0) {
+        __atomic_load(&al->window_start, &window_start, __ATOMIC_RELAXED);
+        if (now - window_start >= WINDOW_SECONDS) {
+            adjust(al, now);
+        }
+        pthread_mutex_unlock(&al->adjust_lock);
+    }
+}
+
+double adaptive_limiter_rate(AdaptiveLimiter *al)
+{
+    if (!__atomic_load_n(&al->limiting, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return rate_limiter_get_rate(&al->limiter);
+}
+
+void adaptive_limiter_destroy(AdaptiveLimiter *al)
+{
+    pthread_mutex_destroy(&al->adjust_lock);
+    rate_limiter_destroy(&al->limiter);
+    free(al);
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_ADAPTIVE_LIMITER_H
+#define INC_BINDFS_ADAPTIVE_LIMITER_H
+
+#include <stddef.h>
+
+/* A rate limit that adjusts itself to keep the 99th percentile latency of
+ * the operations it limits under a target.
+ *
+ * Latencies are collected into a histogram over windows of about a second.
+ * When a window's p99 is over the target, the rate is halved from the
+ * throughput seen in the window. When it is under, the rate grows by a
+ * constant step, and once the limit is well above the actual throughput,
+ * limiting stops until latency goes over the target again (AIMD). */
+typedef struct AdaptiveLimiter AdaptiveLimiter;
+
+/* `target_latency` is in seconds. The rate never goes below `min_rate`. */
+AdaptiveLimiter *adaptive_limiter_create(double target_latency, double min_rate,
+                                         double (*clock)(void));
+/* Like `rate_limiter_wait_nosleep`. Returns 0 when not limiting. */
+double adaptive_limiter_wait_nosleep(AdaptiveLimiter *al, size_t size);
+/* Records an operation of `size` units that took `latency` seconds. */
+void adaptive_limiter_record(AdaptiveLimiter *al, double latency, size_t size);
+/* The current rate, or 0 if not limiting. */
+double adaptive_limiter_rate(AdaptiveLimiter *al);
+/* Destroys the limiter. No other calls may be active. */
+void adaptive_limiter_destroy(AdaptiveLimiter *al);
+
+#endif
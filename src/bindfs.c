@@ -55,6 +55,7 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fnmatch.h>
 #include <getopt.h>
 #include <assert.h>
 #include <pwd.h>
@@ -73,6 +74,7 @@
 
 #ifdef __linux__
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <linux/fs.h>  // For BLKGETSIZE64
 
@@ -83,14 +85,31 @@
 
 #include <fuse.h>
 #include <fuse_opt.h>
+#ifdef HAVE_FUSE_3
+#include <fuse_lowlevel.h>  // For fuse_session_fd()
+#endif
 
+#include "adaptive_limiter.h"
 #include "arena.h"
 #include "debug.h"
+#include "dir_reader.h"
+#include "fair_queue.h"
+#include "group_commit.h"
 #include "misc.h"
+#include "passthrough.h"
 #include "permchain.h"
 #include "rate_limiter.h"
+#include "rate_limiter_table.h"
+#include "readahead.h"
+#include "shared_limiter.h"
+#include "stats.h"
+#include "metrics.h"
+#include "accounting.h"
+#include "trace.h"
+#include "probes.h"
 #include "userinfo.h"
 #include "usermap.h"
+#include "write_behind.h"
 
 /* Socket file support for MacOS and FreeBSD */
 #if defined(__APPLE__) || defined(__FreeBSD__)
@@ -117,6 +136,41 @@ static const int64_t GID_T_MAX = ((1LL << (sizeof(gid_t)*8-1)) - 1);
 static const int UID_GID_OVERFLOW_ERRNO = EIO;
 
 /* SETTINGS */
+
+/* What to do when a file is fsync()'ed. */
+enum SyncPolicy {
+    SYNC_PASSTHROUGH,
+    SYNC_IGNORE,
+    SYNC_GROUP_COMMIT
+};
+
+struct SyncRule {
+    char *pattern;
+    enum SyncPolicy policy;
+};
+
+/* Groups of operations that can be given their own --op-rate. */
+enum OpClass {
+    OP_CLASS_LOOKUP,   /* getattr, readlink, open, statfs */
+    OP_CLASS_READDIR,  /* opendir, readdir */
+    OP_CLASS_CREATE,   /* create, mknod, mkdir, symlink, link, unlink, rmdir, rename */
+    OP_CLASS_SETATTR,  /* chmod, chown, truncate, utimens */
+    OP_CLASS_XATTR,    /* getxattr, setxattr, listxattr, removexattr */
+    NUM_OP_CLASSES
+};
+
+static const char *op_class_names[NUM_OP_CLASSES] = {
+    "lookup", "readdir", "create", "setattr", "xattr"
+};
+
+/* Open flags that can be configured to select direct I/O. */
+enum DirectIoFlags {
+    DIRECT_IO_ON_ODIRECT = 1,
+    DIRECT_IO_ON_APPEND = 2,
+    DIRECT_IO_ON_WRONLY = 4,
+    DIRECT_IO_ON_SYNC = 8
+};
+
 static struct Settings {
     const char *progname;
     struct permchain *permchain; /* permission bit rules. see permchain.h */
@@ -137,6 +191,19 @@ static struct Settings {
 
     RateLimiter *read_limiter;
     RateLimiter *write_limiter;
+    SharedLimiter *shared_limiter;  /* From --shared-rate-limit. */
+    double shared_rates[NUM_SHARED_BUCKETS];  /* 0 if not limited. Changed atomically. */
+    FairQueue *read_queue;  /* Shares read_limiter fairly. From --fair-queue. */
+    FairQueue *write_queue;
+    RateLimiterTable *user_read_limiters;  /* From --read-rate-per-user. */
+    RateLimiterTable *user_write_limiters;
+    int rate_limit_by_gid;  /* Key per-user limiters by gid instead of uid. */
+    int fair_queue;
+    RateLimiter *op_limiters[NUM_OP_CLASSES];  /* From --op-rate. Ops per second. */
+    RateLimiterTable *user_op_limiters[NUM_OP_CLASSES];  /* From --op-rate-per-user. */
+    char *rate_config;  /* Absolute path from --rate-config. Reloaded on SIGUSR2. */
+    AdaptiveLimiter *read_latency_limiter;  /* From --latency-target. */
+    AdaptiveLimiter *write_latency_limiter;
 
     enum CreatePolicy {
         CREATE_AS_USER,
@@ -207,8 +274,38 @@ static struct Settings {
     size_t odirect_alignment;
 
     bool direct_io;
+    char **direct_io_patterns;  /* Files matching any of these use direct I/O. */
+    int num_direct_io_patterns;
+    off_t direct_io_min_size;   /* Files at least this large use direct I/O. 0 if unset. */
+    int direct_io_flags;        /* Opens with any of these DIRECT_IO_ON_* flags use direct I/O. */
 #endif
 
+    int keep_cache;
+
+    size_t source_readahead;  /* Max. readahead hint window. 0 if disabled. */
+
+    size_t write_behind;  /* Write buffer size per open file. 0 if disabled. */
+
+    enum SyncPolicy sync_policy;
+    struct SyncRule *sync_rules;  /* Per-path exceptions to sync_policy. First match wins. */
+    int num_sync_rules;
+    unsigned int sync_interval_ms;  /* Batching delay for SYNC_GROUP_COMMIT. */
+
+    int passthrough;
+
+    int multithreaded;
+    int serialize_ops;  /* Run multithreaded but one operation at a time. See serial_lock. */
+    int stats;  /* Record operation latencies and show them in stats_path. */
+    int metrics;  /* Publish counters for bindfs-stat. From --metrics. */
+    int accounting;  /* Account usage per user in accounting_file_path. */
+    int accounting_by_pid;  /* Account per user and process instead. */
+    int trace_fd;  /* From --trace. -1 if not tracing. */
+    uint64_t trace_max_size;  /* From --trace-max-size. 0 if unlimited. */
+
+    size_t max_write;      /* 0 if not set. */
+    size_t max_read;       /* 0 if not set. */
+    size_t max_readahead;  /* 0 if not set. */
+
     int64_t uid_offset;
     int64_t gid_offset;
 
@@ -216,20 +313,79 @@ static struct Settings {
 
 static bool bindfs_init_failed = false;
 
+/* Open directories have a dir_reader in fi->fh. */
+static struct dir_reader *get_dir_reader(struct fuse_file_info *fi)
+{
+    return (struct dir_reader *)(uintptr_t)fi->fh;
+}
+
+/* Open files have an open_file in fi->fh. */
+struct open_file {
+    int fd;
+    int backing_id;  /* Kernel passthrough backing file ID, or 0. */
+    struct readahead_state readahead;  /* Only with --source-readahead. */
+    struct write_behind *write_behind;  /* NULL unless --write-behind applies. */
+    dev_t dev;  /* Only set with --write-behind. */
+    ino_t ino;
+};
+
+static struct open_file *get_open_file(struct fuse_file_info *fi)
+{
+    return (struct open_file *)(uintptr_t)fi->fh;
+}
+
+static int get_fd(struct fuse_file_info *fi)
+{
+    return get_open_file(fi)->fd;
+}
+
+/* Writes out data held back by --write-behind for the file,
+   including data written through other handles. Returns 0 or -errno. */
+static int flush_write_behind(struct fuse_file_info *fi)
+{
+    struct open_file *of = get_open_file(fi);
+    int res = 0;
+    if (of->write_behind) {
+        res = write_behind_flush(of->write_behind);
+    }
+    if (res == 0 && settings.write_behind) {
+        res = write_behind_flush_inode(of->dev, of->ino);
+    }
+    return res;
+}
+
+/* How often buffers of --write-behind are flushed in the background. */
+static const unsigned int write_behind_interval_ms = 100;
+
+/* --latency-target never throttles below this many bytes per second. */
+static const double latency_target_min_rate = 64 * 1024;
+
+/* How often the events of --trace are written to the file. */
+static const unsigned int trace_drain_interval_ms = 100;
+
+#ifdef PASSTHROUGH_SUPPORTED
+/* The FUSE device, for registering passthrough backing files. */
+static int fuse_dev_fd = -1;
+#endif
+
 
 
 /* PROTOTYPES */
 
 static int is_mirroring_enabled(void);
 
+/* Whether any read, write or operation rate limit is set. */
+static int is_throttling_enabled(void);
+
 /* Checks whether the uid is to be the mirrored owner of all files. */
 static int is_mirrored_user(uid_t uid);
 
 /* Processes the virtual path to a real path. Always free() the result. */
 static char *process_path(const char *path, bool resolve_symlinks);
 
-/* The common parts of getattr and fgetattr. */
-static int getattr_common(const char *path, struct stat *stbuf);
+/* The common parts of getattr, fgetattr and readdir.
+   The path is relative to dirfd, which may be AT_FDCWD. */
+static int getattr_common(int dirfd, const char *procpath, struct stat *stbuf);
 
 /* Chowns a new file if necessary. */
 static int chown_new_file(const char *path, struct fuse_context *fc, int (*chown_func)(const char*, uid_t, gid_t));
@@ -244,10 +400,54 @@ static bool unapply_uid_offset(uid_t *uid);
 static bool unapply_gid_offset(gid_t *gid);
 static bool bounded_add(int64_t* a, int64_t b, int64_t max);
 
+/* Matches a path inside the mount against a shell pattern.
+   Patterns without a slash only need to match the file name. */
+static bool path_matches(const char *pattern, const char *path);
+
+/* Decides whether to bypass the kernel's page cache for a newly opened file,
+   and sets fi->direct_io and fi->keep_cache accordingly. */
+static void set_cache_mode(const char *path, int fd, struct fuse_file_info *fi);
+
+/* Wraps a newly opened fd in an open_file and stores it in fi->fh.
+   Closes the fd on failure. */
+static int attach_open_file(struct fuse_file_info *fi, int fd);
+
+/* With --stats or --accounting, a hidden directory in the mount root holds
+   read-only files with the operation statistics and per-user usage. */
+static const char stats_dir_path[] = "/.bindfs";
+static const char stats_file_path[] = "/.bindfs/stats";
+static const char accounting_file_path[] = "/.bindfs/accounting";
+static bool has_stats_dir(void);
+/* Whether `path` is one of the above files and it's enabled. */
+static bool is_stats_file(const char *path);
+/* Fills in `stbuf` and returns true if `path` is one of the above. */
+static bool getattr_stats_path(const char *path, struct stat *stbuf);
+/* Opens a snapshot of the file at `path`. Returns an fd or -errno. */
+static int open_stats_snapshot(const char *path);
+/* Adds to the current user's --accounting entry. */
+static void account_op(double seconds);
+static void account_bytes(uint64_t bytes_read, uint64_t bytes_written);
+
 #ifdef __linux__
 static size_t round_up_buffer_size_for_direct_io(size_t size);
 #endif
 
+/* Let other operations run while blocking, in serialized mode. */
+static void release_serial_lock(void);
+static void reacquire_serial_lock(void);
+
+/* Blocks until the global and per-user limits allow `size` more bytes. */
+static void wait_for_read_permit(size_t size);
+static void wait_for_write_permit(size_t size);
+/* Blocks until the global and per-user limits allow one more operation. */
+static void wait_for_op_permit(enum OpClass op_class);
+
+/* Whether any file may use SYNC_GROUP_COMMIT. */
+static bool uses_group_commit(void);
+
+/* Sets the maximum request sizes and readahead in bindfs_init. */
+static void set_request_sizes(struct fuse_conn_info *conn);
+
 /* FUSE callbacks */
 #ifdef HAVE_FUSE_3
 static void *bindfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
@@ -264,6 +464,7 @@ static int bindfs_fgetattr(const char *path, struct stat *stbuf,
                            struct fuse_file_info *fi);
 #endif
 static int bindfs_readlink(const char *path, char *buf, size_t size);
+static int bindfs_opendir(const char *path, struct fuse_file_info *fi);
 #ifdef HAVE_FUSE_3
 static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                           off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
@@ -271,6 +472,7 @@ static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                           off_t offset, struct fuse_file_info *fi);
 #endif
+static int bindfs_releasedir(const char *path, struct fuse_file_info *fi);
 static int bindfs_mknod(const char *path, mode_t mode, dev_t rdev);
 static int bindfs_mkdir(const char *path, mode_t mode);
 static int bindfs_unlink(const char *path);
@@ -315,6 +517,8 @@ static int bindfs_write(const char *path, const char *buf, size_t size,
 static int bindfs_lock(const char *path, struct fuse_file_info *fi, int cmd,
                        struct flock *lock);
 static int bindfs_flock(const char *path, struct fuse_file_info *fi, int op);
+static int bindfs_fallocate(const char *path, int mode, off_t offset,
+                            off_t length, struct fuse_file_info *fi);
 #endif
 #ifdef HAVE_FUSE_3
 static int bindfs_ioctl(const char *path, int cmd, void *arg,
@@ -332,6 +536,19 @@ static int bindfs_statfs_x(const char *path, struct statfs *stbuf);
 static int bindfs_release(const char *path, struct fuse_file_info *fi);
 static int bindfs_fsync(const char *path, int isdatasync,
                         struct fuse_file_info *fi);
+static int bindfs_fsyncdir(const char *path, int isdatasync,
+                           struct fuse_file_info *fi);
+static int bindfs_flush(const char *path, struct fuse_file_info *fi);
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_COPY_FILE_RANGE
+static ssize_t bindfs_copy_file_range(const char *path_in, struct fuse_file_info *fi_in,
+                                      off_t offset_in, const char *path_out,
+                                      struct fuse_file_info *fi_out, off_t offset_out,
+                                      size_t size, int flags);
+#endif
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_LSEEK
+static off_t bindfs_lseek(const char *path, off_t offset, int whence,
+                          struct fuse_file_info *fi);
+#endif
 
 
 static void print_usage(const char *progname);
@@ -339,11 +556,24 @@ static void print_usage(const char *progname);
 static int process_option(void *data, const char *arg, int key,
                           struct fuse_args *outargs);
 static int parse_mirrored_users(char* mirror);
+static int parse_request_size(const char *str, size_t *result);
+static int parse_sync_policy(const char *str, enum SyncPolicy *result);
+static int parse_sync_rules(const char *spec);
+static int parse_op_rates(const char *spec, int per_user);
+static int parse_fair_queue_weights(const char *spec);
+static int load_rate_config(const char *path);
+#ifdef __linux__
+static int parse_direct_io_paths(const char *spec);
+static int parse_direct_io_flags(const char *spec);
+#endif
 static int parse_user_map(UserMap *map, UserMap *reverse_map, char *spec);
 static char *get_working_dir(void);
 static void maybe_stdout_stderr_to_file(void);
 
-/* Sets up handling of SIGUSR1. */
+/* Set by SIGUSR2. The rate config is reloaded on the next read or write. */
+static volatile sig_atomic_t rate_config_reload_requested = 0;
+
+/* Sets up handling of SIGUSR1 and SIGUSR2. */
 static void setup_signal_handling(void);
 static void signal_handler(int sig);
 
@@ -364,6 +594,21 @@ static int is_mirroring_enabled(void)
     return settings.num_mirrored_users + settings.num_mirrored_members > 0;
 }
 
+static int is_throttling_enabled(void)
+{
+    if (settings.read_limiter || settings.write_limiter ||
+        settings.user_read_limiters || settings.user_write_limiters ||
+        settings.shared_limiter || settings.read_latency_limiter) {
+        return 1;
+    }
+    for (int i = 0; i < NUM_OP_CLASSES; ++i) {
+        if (settings.op_limiters[i] || settings.user_op_limiters[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static int is_mirrored_user(uid_t uid)
 {
     int i;
@@ -394,7 +639,9 @@ static char *process_path(const char *path, bool resolve_symlinks)
         path = ".";
 
     if (resolve_symlinks && settings.resolve_symlinks) {
+        BINDFS_PROBE1(source__entry, "realpath");
         char* result = realpath(path, NULL);
+        BINDFS_PROBE2(source__exit, "realpath", result == NULL ? -errno : 0);
         if (result == NULL) {
             if (errno == ENOENT) {
                 /* Broken symlink (or missing file). Don't return null because
@@ -415,10 +662,18 @@ static char *process_path(const char *path, bool resolve_symlinks)
     }
 }
 
-static int getattr_common(const char *procpath, struct stat *stbuf)
+static int getattr_common(int dirfd, const char *procpath, struct stat *stbuf)
 {
     struct fuse_context *fc = fuse_get_context();
 
+    /* Count writes that haven't reached the source yet. */
+    if (settings.write_behind && S_ISREG(stbuf->st_mode)) {
+        off_t pending_end = write_behind_pending_end(stbuf->st_dev, stbuf->st_ino);
+        if (pending_end > stbuf->st_size) {
+            stbuf->st_size = pending_end;
+        }
+    }
+
     /* Copy mtime (file content modification time)
        to ctime (inode/status change time)
        if the user asked for that */
@@ -464,7 +719,7 @@ static int getattr_common(const char *procpath, struct stat *stbuf)
     /* Block files as regular files. */
     if (settings.block_devices_as_files && S_ISBLK(stbuf->st_mode)) {
         stbuf->st_mode ^= S_IFBLK | S_IFREG;  // Flip both bits
-        int fd = open(procpath, O_RDONLY);
+        int fd = openat(dirfd, procpath, O_RDONLY);
         if (fd == -1) {
             return -errno;
         }
@@ -494,11 +749,11 @@ static int getattr_common(const char *procpath, struct stat *stbuf)
 
         /* Check that we can really do what we promise if --realistic-permissions was given */
         if (settings.realistic_permissions) {
-            if (access(procpath, R_OK) == -1)
+            if (faccessat(dirfd, procpath, R_OK, 0) == -1)
                 stbuf->st_mode &= ~0444;
-            if (access(procpath, W_OK) == -1)
+            if (faccessat(dirfd, procpath, W_OK, 0) == -1)
                 stbuf->st_mode &= ~0222;
-            if (access(procpath, X_OK) == -1)
+            if (faccessat(dirfd, procpath, X_OK, 0) == -1)
                 stbuf->st_mode &= ~0111;
         }
     }
@@ -571,6 +826,8 @@ static int delete_file(const char *path, int (*target_delete_func)(const char *)
      if (settings.delete_deny)
         return -EPERM;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_path = process_path(path, false);
     if (real_path == NULL)
         return -errno;
@@ -686,6 +943,300 @@ static bool bounded_add(int64_t* a, int64_t b, int64_t max) {
     return false;
 }
 
+static unsigned int rate_limit_key(void)
+{
+    struct fuse_context *ctx = fuse_get_context();
+    return settings.rate_limit_by_gid ? ctx->gid : ctx->uid;
+}
+
+/* `shared_bucket` is an enum SharedBucket, or -1 for none. */
+static void wait_for_permit(RateLimiter *limiter, FairQueue *queue,
+                            RateLimiterTable *user_limiters, int shared_bucket,
+                            AdaptiveLimiter *latency_limiter, size_t size)
+{
+    double time_to_sleep = 0;
+
+    if (rate_config_reload_requested) {
+        /* Only one thread gets to reload. */
+        if (__atomic_exchange_n(&rate_config_reload_requested, 0, __ATOMIC_RELAXED)) {
+            if (load_rate_config(settings.rate_config)) {
+                DPRINTF("Reloaded rate config %s", settings.rate_config);
+            }
+        }
+    }
+
+    if (user_limiters) {
+        time_to_sleep = rate_limiter_table_wait_nosleep(user_limiters, rate_limit_key(), size);
+    }
+    double shared_rate = 0;
+    if (shared_bucket >= 0) {
+        __atomic_load(&settings.shared_rates[shared_bucket], &shared_rate, __ATOMIC_RELAXED);
+    }
+    if (shared_rate > 0) {
+        double shared_time_to_sleep = shared_limiter_wait_nosleep(
+            settings.shared_limiter, shared_bucket, shared_rate, size);
+        if (shared_time_to_sleep > time_to_sleep) {
+            time_to_sleep = shared_time_to_sleep;
+        }
+    }
+    if (latency_limiter) {
+        double latency_time_to_sleep = adaptive_limiter_wait_nosleep(latency_limiter, size);
+        if (latency_time_to_sleep > time_to_sleep) {
+            time_to_sleep = latency_time_to_sleep;
+        }
+    }
+
+    if (queue) {
+        unsigned int key = rate_limit_key();
+        release_serial_lock();
+        /* Wait for our own and the shared limit first, so as not to hold
+           up the queue. */
+        double start = settings.metrics ? monotonic_clock() : 0;
+        BINDFS_PROBE1(throttle__sleep, (int64_t)(time_to_sleep * 1e9));
+        if (time_to_sleep > 0) {
+            rate_limiter_sleep(time_to_sleep);
+        }
+        fair_queue_wait(queue, key, size);
+        BINDFS_PROBE0(throttle__wake);
+        if (settings.metrics) {
+            metrics_add(METRIC_THROTTLE_NS, (monotonic_clock() - start) * 1e9);
+        }
+        reacquire_serial_lock();
+        return;
+    }
+
+    if (limiter) {
+        double global_time_to_sleep = rate_limiter_wait_nosleep(limiter, size);
+        if (global_time_to_sleep > time_to_sleep) {
+            time_to_sleep = global_time_to_sleep;
+        }
+    }
+
+    if (time_to_sleep > 0) {
+        release_serial_lock();
+        BINDFS_PROBE1(throttle__sleep, (int64_t)(time_to_sleep * 1e9));
+        rate_limiter_sleep(time_to_sleep);
+        BINDFS_PROBE0(throttle__wake);
+        metrics_add(METRIC_THROTTLE_NS, time_to_sleep * 1e9);
+        reacquire_serial_lock();
+    }
+}
+
+static void wait_for_read_permit(size_t size)
+{
+    wait_for_permit(settings.read_limiter, settings.read_queue, settings.user_read_limiters,
+                    SHARED_BUCKET_READ, settings.read_latency_limiter, size);
+}
+
+static void wait_for_write_permit(size_t size)
+{
+    wait_for_permit(settings.write_limiter, settings.write_queue, settings.user_write_limiters,
+                    SHARED_BUCKET_WRITE, settings.write_latency_limiter, size);
+}
+
+static void wait_for_op_permit(enum OpClass op_class)
+{
+    wait_for_permit(settings.op_limiters[op_class], NULL, settings.user_op_limiters[op_class],
+                    -1, NULL, 1);
+}
+
+static bool path_matches(const char *pattern, const char *path)
+{
+    const char *subject = strchr(pattern, '/') ? path : my_basename(path);
+    return fnmatch(pattern, subject, 0) == 0;
+}
+
+#ifdef __linux__
+static bool use_direct_io(const char *path, int fd, int flags)
+{
+    if (settings.direct_io) {
+        return true;
+    }
+
+    if ((settings.direct_io_flags & DIRECT_IO_ON_ODIRECT) && (flags & O_DIRECT)) {
+        return true;
+    }
+    if ((settings.direct_io_flags & DIRECT_IO_ON_APPEND) && (flags & O_APPEND)) {
+        return true;
+    }
+    if ((settings.direct_io_flags & DIRECT_IO_ON_WRONLY) && (flags & O_ACCMODE) == O_WRONLY) {
+        return true;
+    }
+    if ((settings.direct_io_flags & DIRECT_IO_ON_SYNC) && (flags & O_DSYNC)) {
+        return true;
+    }
+
+    for (int i = 0; i < settings.num_direct_io_patterns; ++i) {
+        if (path_matches(settings.direct_io_patterns[i], path)) {
+            return true;
+        }
+    }
+
+    if (settings.direct_io_min_size > 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= settings.direct_io_min_size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
+static void set_cache_mode(const char *path, int fd, struct fuse_file_info *fi)
+{
+#ifdef __linux__
+    fi->direct_io = use_direct_io(path, fd, fi->flags);
+#ifdef HAVE_STRUCT_FUSE_FILE_INFO_PARALLEL_DIRECT_WRITES
+    if (fi->direct_io && settings.multithreaded) {
+        fi->parallel_direct_writes = 1;
+    }
+#endif
+#else
+    (void)path;
+    (void)fd;
+#endif
+
+    if (settings.keep_cache && !fi->direct_io) {
+        fi->keep_cache = 1;
+    }
+}
+
+static int attach_open_file(struct fuse_file_info *fi, int fd)
+{
+    struct open_file *of = malloc(sizeof(struct open_file));
+    if (of == NULL) {
+        close(fd);
+        return -ENOMEM;
+    }
+    of->fd = fd;
+    of->backing_id = 0;
+    if (settings.source_readahead) {
+        readahead_init(&of->readahead, settings.source_readahead);
+    }
+
+#ifdef PASSTHROUGH_SUPPORTED
+    /* Reads and writes bypass us entirely in passthrough mode,
+       so we can only use it when we'd pass the data through unchanged. */
+    bool can_pass_through = settings.passthrough && !fi->direct_io;
+    if (settings.forward_odirect && (fi->flags & O_DIRECT)) {
+        can_pass_through = false;
+    }
+    struct stat st;
+    if (can_pass_through && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        int backing_id = passthrough_open(fuse_dev_fd, fd);
+        if (backing_id > 0) {
+            of->backing_id = backing_id;
+            fi->backing_id = backing_id;
+        } else {
+            DPRINTF("Failed to register passthrough backing file: %s", strerror(-backing_id));
+        }
+    }
+#endif
+
+    of->write_behind = NULL;
+    of->dev = 0;
+    of->ino = 0;
+    if (settings.write_behind) {
+        struct stat file_st;
+        if (fstat(fd, &file_st) == 0) {
+            of->dev = file_st.st_dev;
+            of->ino = file_st.st_ino;
+        }
+    }
+
+    /* Synchronous and O_DIRECT writers expect their writes to reach the source. */
+    bool can_write_behind = settings.write_behind
+        && of->backing_id == 0
+        && (fi->flags & O_ACCMODE) != O_RDONLY
+        && !(fi->flags & O_DSYNC);
+#ifdef __linux__
+    if (settings.forward_odirect && (fi->flags & O_DIRECT)) {
+        can_write_behind = false;
+    }
+#endif
+    if (can_write_behind) {
+        of->write_behind = write_behind_create(fd, settings.write_behind);
+    }
+
+    fi->fh = (uintptr_t)of;
+    return 0;
+}
+
+static bool has_stats_dir(void)
+{
+    return settings.stats || settings.accounting;
+}
+
+static bool is_stats_file(const char *path)
+{
+    return (settings.stats && strcmp(path, stats_file_path) == 0) ||
+        (settings.accounting && strcmp(path, accounting_file_path) == 0);
+}
+
+static bool getattr_stats_path(const char *path, struct stat *stbuf)
+{
+    bool is_dir = has_stats_dir() && strcmp(path, stats_dir_path) == 0;
+    if (!is_dir && !is_stats_file(path)) {
+        return false;
+    }
+
+    memset(stbuf, 0, sizeof(*stbuf));
+    if (is_dir) {
+        stbuf->st_mode = S_IFDIR | 0555;
+        stbuf->st_nlink = 2;
+    } else {
+        /* The size is unknown until the file is opened. It's opened with
+           direct_io so that reads aren't cut short by this. */
+        stbuf->st_mode = S_IFREG | 0444;
+        if (strcmp(path, accounting_file_path) == 0) {
+            stbuf->st_mode = S_IFREG | 0400;  /* Shows what other users are doing. */
+        }
+        stbuf->st_nlink = 1;
+    }
+    stbuf->st_uid = getuid();
+    stbuf->st_gid = getgid();
+    stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = time(NULL);
+    return true;
+}
+
+static int open_stats_snapshot(const char *path)
+{
+    FILE *f = tmpfile();
+    if (f == NULL) {
+        return -errno;
+    }
+    if (strcmp(path, accounting_file_path) == 0) {
+        accounting_print(f, settings.accounting_by_pid);
+    } else {
+        stats_print(f);
+    }
+    if (fflush(f) != 0) {
+        int saved_errno = errno;
+        fclose(f);
+        return -saved_errno;
+    }
+    int fd = dup(fileno(f));
+    int saved_errno = errno;
+    fclose(f);
+    return fd == -1 ? -saved_errno : fd;
+}
+
+static void account_op(double seconds)
+{
+    struct fuse_context *ctx = fuse_get_context();
+    accounting_record_op(ctx->uid, settings.accounting_by_pid ? ctx->pid : 0, seconds);
+}
+
+static void account_bytes(uint64_t bytes_read, uint64_t bytes_written)
+{
+    if (settings.accounting) {
+        struct fuse_context *ctx = fuse_get_context();
+        accounting_add_bytes(ctx->uid, settings.accounting_by_pid ? ctx->pid : 0,
+                             bytes_read, bytes_written);
+    }
+}
+
 #ifdef __linux__
 static size_t round_up_buffer_size_for_direct_io(size_t size)
 {
@@ -701,16 +1252,92 @@ static size_t round_up_buffer_size_for_direct_io(size_t size)
 }
 #endif
 
+/* Larger requests mean fewer round trips through the kernel.
+   libfuse derives the kernel's max_pages from max_write. */
+static const size_t default_request_size = 1024 * 1024;
+
+static void set_request_sizes(struct fuse_conn_info *conn)
+{
+    /* Default to the source filesystem's preferred I/O size if it's larger. */
+    size_t io_size = default_request_size;
+    struct stat st;
+    if (fstat(settings.mntsrc_fd, &st) == 0 && st.st_blksize > 0 && (size_t)st.st_blksize > io_size) {
+        io_size = st.st_blksize;
+    }
+
+    conn->max_write = settings.max_write ? settings.max_write : io_size;
+#ifdef FUSE_CAP_BIG_WRITES
+    /* Without this, FUSE 2 splits writes into 4 KiB requests. */
+    if (conn->capable & FUSE_CAP_BIG_WRITES) {
+        conn->want |= FUSE_CAP_BIG_WRITES;
+    }
+#endif
+
+#ifdef HAVE_FUSE_3
+    /* Must also be given as -o max_read, which main() does. */
+    if (settings.max_read) {
+        conn->max_read = settings.max_read;
+    }
+#endif
+
+    /* The kernel won't go above what it offered, which is the
+       readahead setting of the mount's BDI. */
+    if (settings.max_readahead && settings.max_readahead < conn->max_readahead) {
+        conn->max_readahead = settings.max_readahead;
+    }
+
+    DPRINTF("max_write: %u, max_readahead: %u",
+            (unsigned)conn->max_write, (unsigned)conn->max_readahead);
+}
+
 #ifdef HAVE_FUSE_3
 static void *bindfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
 #else
 static void *bindfs_init(struct fuse_conn_info *conn)
 #endif
 {
-    (void) conn;
+    set_request_sizes(conn);
+
+    /* We may have daemonized since the metrics segment was created. */
+    metrics_set_pid(getpid());
+
+    /* Threads must be started here rather than before fuse_main daemonizes. */
+    if (settings.write_behind) {
+        int res = write_behind_start(write_behind_interval_ms);
+        if (res != 0) {
+            fprintf(stderr, "Warning: could not start write-behind thread: %s\n", strerror(res));
+        }
+    }
+    if (uses_group_commit()) {
+        int res = group_commit_start(settings.sync_interval_ms);
+        if (res != 0) {
+            fprintf(stderr, "Warning: could not start group commit thread: %s\n", strerror(res));
+        }
+    }
+    if (settings.trace_fd != -1) {
+        int res = trace_start(settings.trace_fd, trace_drain_interval_ms,
+                              settings.trace_max_size);
+        if (res != 0) {
+            fprintf(stderr, "Warning: could not start tracing: %s\n", strerror(res));
+        }
+    }
+
     #ifdef HAVE_FUSE_3
     cfg->use_ino = 1;
 
+#ifdef PASSTHROUGH_SUPPORTED
+    if (settings.passthrough) {
+        if (conn->capable & FUSE_CAP_PASSTHROUGH) {
+            conn->want |= FUSE_CAP_PASSTHROUGH;
+            conn->max_backing_stack_depth = 1;
+            fuse_dev_fd = fuse_session_fd(fuse_get_session(fuse_get_context()->fuse));
+        } else {
+            fprintf(stderr, "Warning: the kernel does not support FUSE passthrough. Ignoring --passthrough.\n");
+            settings.passthrough = 0;
+        }
+    }
+#endif
+
     // Disable caches so changes in base FS are visible immediately.
     // Especially the attribute cache must be disabled when different users
     // might see different file attributes, such as when mirroring users.
@@ -719,6 +1346,10 @@ static void *bindfs_init(struct fuse_conn_info *conn)
     cfg->negative_timeout = 0;
 #ifdef __linux__
     cfg->direct_io = settings.direct_io;
+#ifdef HAVE_STRUCT_FUSE_CONFIG_PARALLEL_DIRECT_WRITES
+    /* Otherwise the kernel serializes direct writes to the same file. */
+    cfg->parallel_direct_writes = settings.direct_io && settings.multithreaded;
+#endif
 #endif
     #endif
 
@@ -748,6 +1379,16 @@ static void *bindfs_init(struct fuse_conn_info *conn)
 static void bindfs_destroy(void *private_data)
 {
     (void)private_data;
+
+    if (settings.write_behind) {
+        write_behind_stop();
+    }
+    if (uses_group_commit()) {
+        group_commit_stop();
+    }
+    if (settings.trace_fd != -1) {
+        trace_stop();
+    }
 }
 
 #ifdef HAVE_FUSE_3
@@ -763,16 +1404,24 @@ static int bindfs_getattr(const char *path, struct stat *stbuf)
     (void)fi;
 #endif
 
+    if (getattr_stats_path(path, stbuf))
+        return 0;
+
+    wait_for_op_permit(OP_CLASS_LOOKUP);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
 
-    if (lstat(real_path, stbuf) == -1) {
+    BINDFS_PROBE1(source__entry, "lstat");
+    res = lstat(real_path, stbuf);
+    BINDFS_PROBE2(source__exit, "lstat", res == -1 ? -errno : 0);
+    if (res == -1) {
         free(real_path);
         return -errno;
     }
 
-    res = getattr_common(real_path, stbuf);
+    res = getattr_common(AT_FDCWD, real_path, stbuf);
     free(real_path);
     return res;
 }
@@ -784,15 +1433,20 @@ static int bindfs_fgetattr(const char *path, struct stat *stbuf,
     int res;
     char *real_path;
 
+    if (getattr_stats_path(path, stbuf))
+        return 0;
+
+    wait_for_op_permit(OP_CLASS_LOOKUP);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
 
-    if (fstat(fi->fh, stbuf) == -1) {
+    if (fstat(get_fd(fi), stbuf) == -1) {
         free(real_path);
         return -errno;
     }
-    res = getattr_common(real_path, stbuf);
+    res = getattr_common(AT_FDCWD, real_path, stbuf);
     free(real_path);
     return res;
 }
@@ -803,6 +1457,8 @@ static int bindfs_readlink(const char *path, char *buf, size_t size)
     int res;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_LOOKUP);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -820,121 +1476,140 @@ static int bindfs_readlink(const char *path, char *buf, size_t size)
     return 0;
 }
 
-#ifdef HAVE_FUSE_3
-static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                          off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
-#else
-static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                          off_t offset, struct fuse_file_info *fi)
-#endif
+static int bindfs_opendir(const char *path, struct fuse_file_info *fi)
 {
-    (void)offset;
-    (void)fi;
-#ifdef HAVE_FUSE_3
-    bool readdirplus = (flags & FUSE_READDIR_PLUS) == FUSE_READDIR_PLUS;
-    enum fuse_fill_dir_flags fill_dir_flags = readdirplus ? FUSE_FILL_DIR_PLUS : 0;
-#else
-    bool readdirplus = false;
-#endif
-    char *real_path = process_path(path, true);
+    if (has_stats_dir() && strcmp(path, stats_dir_path) == 0) {
+        fi->fh = (uintptr_t)NULL;  /* Listed by bindfs_readdir without a dir_reader. */
+        return 0;
+    }
+
+    wait_for_op_permit(OP_CLASS_READDIR);
+
+    char *real_path = process_path(path, true);
     if (real_path == NULL) {
         return -errno;
     }
 
-    DIR *dp = opendir(real_path);
-    if (dp == NULL) {
-        free(real_path);
+    int fd = open(real_path, O_RDONLY | O_DIRECTORY);
+    free(real_path);
+    if (fd == -1) {
         return -errno;
     }
 
-    long pc_ret = pathconf(real_path, _PC_NAME_MAX);
-    if (pc_ret < 0) {
-        DPRINTF("pathconf failed: %s (%d)", strerror(errno), errno);
-        pc_ret = NAME_MAX;
-    } else if (pc_ret == 0) {
-        // Workaround for some source filesystems erroneously returning 0
-        // (see issue #54).
-        pc_ret = NAME_MAX;
+    struct dir_reader *dr = dir_reader_open(fd);
+    if (dr == NULL) {
+        int saved_errno = errno;
+        close(fd);
+        return -saved_errno;
     }
 
-    struct memory_block path_buf = MEMORY_BLOCK_INITIALIZER;
-    if (settings.resolve_symlinks || readdirplus) {
-        int len = strlen(real_path);
-        append_to_memory_block(&path_buf, real_path, len + 1);
-        path_buf.ptr[len] = '/';
+    fi->fh = (uintptr_t)dr;
+    return 0;
+}
+
+#ifdef HAVE_FUSE_3
+static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                          off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+#else
+static int bindfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                          off_t offset, struct fuse_file_info *fi)
+#endif
+{
+    (void)path;
+    struct dir_reader *dr = get_dir_reader(fi);
+#ifdef HAVE_FUSE_3
+    bool readdirplus = (flags & FUSE_READDIR_PLUS) == FUSE_READDIR_PLUS;
+    enum fuse_fill_dir_flags fill_dir_flags = readdirplus ? FUSE_FILL_DIR_PLUS : 0;
+#else
+    bool readdirplus = false;
+#endif
+
+    if (dr == NULL) {
+        /* The --stats directory. It's small enough to always fit. */
+        if (offset == 0) {
+            const char *names[4] = { ".", ".." };
+            int count = 2;
+            if (settings.accounting) {
+                names[count++] = my_basename(accounting_file_path);
+            }
+            if (settings.stats) {
+                names[count++] = my_basename(stats_file_path);
+            }
+            for (int i = 0; i < count; ++i) {
+            #ifdef HAVE_FUSE_3
+                filler(buf, names[i], NULL, i + 1, 0);
+            #else
+                filler(buf, names[i], NULL, i + 1);
+            #endif
+            }
+        }
+        return 0;
     }
 
-    free(real_path);
-    real_path = NULL;
+    wait_for_op_permit(OP_CLASS_READDIR);
+
+    /* The kernel asks for a different position than where we left off
+       after a rewind or when it lost a reply. See also issue #28. */
+    if (offset != dir_reader_tell(dr)) {
+        dir_reader_seek(dr, offset);
+    }
 
     int result = 0;
     while (1) {
-        errno = 0;
-        struct dirent *de = readdir(dp);
-        if (de == NULL) {
-            if (errno != 0) {
-                result = -errno;
-            }
+        struct dir_reader_entry de;
+        int res = dir_reader_peek(dr, &de);
+        if (res <= 0) {
+            result = res;
             break;
         }
 
         struct stat st;
 
-        if ((settings.resolve_symlinks && de->d_type == DT_LNK) || readdirplus) {
-            int file_len = strlen(de->d_name) + 1;  // (include null terminator)
-            append_to_memory_block(&path_buf, de->d_name, file_len);
-
-            if (settings.resolve_symlinks && de->d_type == DT_LNK) {
-                char *resolved = realpath(path_buf.ptr, NULL);
+        if (readdirplus) {
+            int dirfd = dir_reader_fd(dr);
+            bool maybe_symlink = de.type == DT_LNK || de.type == DT_UNKNOWN;
 
-                if (resolved) {
-                    if (lstat(resolved, &st) == -1) {
-                        result = -errno;
-                        free(resolved);
-                        break;
-                    }
-                    free(resolved);
-                } else if (lstat(path_buf.ptr, &st) == -1) {
+            /* Broken symlinks (or missing files) fall back to lstat
+               like in process_path. */
+            if (!(settings.resolve_symlinks && maybe_symlink &&
+                  fstatat(dirfd, de.name, &st, 0) == 0)) {
+                if (fstatat(dirfd, de.name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
                     result = -errno;
                     break;
                 }
-            } else if (lstat(path_buf.ptr, &st) == -1) {
-                result = -errno;
-                break;
             }
 
-            if (readdirplus) {
-                if ((result = getattr_common(path_buf.ptr, &st)) < 0) {
-                    break;
-                }
+            if ((result = getattr_common(dirfd, de.name, &st)) < 0) {
+                break;
             }
-
-            path_buf.size -= file_len;
         }
 
-        // See issue #28 for why we pass a 0 offset to `filler` and ignore
-        // `offset`.
-        //
-        // Given a 0 offset, `filler` should never return non-zero, so we
-        // consider it an error if it does. It is undocumented whether it sets
-        // errno in that case, so we zero it first and set it ourself if it
-        // doesn't.
+        // `filler` returns non-zero when its buffer is full. We then leave
+        // the entry to be given out first on the next call, which the kernel
+        // makes with the offset of the last entry it got.
         #ifdef HAVE_FUSE_3
-        if (filler(buf, de->d_name, readdirplus ? &st : NULL, 0, fill_dir_flags) != 0) {
+        if (filler(buf, de.name, readdirplus ? &st : NULL, de.next_offset, fill_dir_flags) != 0) {
         #else
-        if (filler(buf, de->d_name, readdirplus ? &st : NULL, 0) != 0) {
+        if (filler(buf, de.name, readdirplus ? &st : NULL, de.next_offset) != 0) {
         #endif
-            result = errno != 0 ? -errno : -EIO;
             break;
         }
+        dir_reader_next(dr);
     }
 
-    if (settings.resolve_symlinks || readdirplus) {
-        free_memory_block(&path_buf);
+    return result;
+}
+
+static int bindfs_releasedir(const char *path, struct fuse_file_info *fi)
+{
+    (void)path;
+
+    struct dir_reader *dr = get_dir_reader(fi);
+    if (dr != NULL) {
+        dir_reader_close(dr);
     }
 
-    closedir(dp);
-    return result;
+    return 0;
 }
 
 static int bindfs_mknod(const char *path, mode_t mode, dev_t rdev)
@@ -943,6 +1618,8 @@ static int bindfs_mknod(const char *path, mode_t mode, dev_t rdev)
     struct fuse_context *fc;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -997,6 +1674,8 @@ static int bindfs_mkdir(const char *path, mode_t mode)
     struct fuse_context *fc;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1036,6 +1715,8 @@ static int bindfs_symlink(const char *from, const char *to)
     if (settings.resolve_symlinks)
         return -EPERM;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_to = process_path(to, false);
     if (real_to == NULL)
         return -errno;
@@ -1065,6 +1746,8 @@ static int bindfs_rename(const char *from, const char *to)
     if (settings.rename_deny)
         return -EPERM;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_from = process_path(from, false);
     if (real_from == NULL)
         return -errno;
@@ -1107,6 +1790,8 @@ static int bindfs_link(const char *from, const char *to)
     int res;
     char *real_from, *real_to;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_from = process_path(from, true);
     if (real_from == NULL)
         return -errno;
@@ -1140,6 +1825,8 @@ static int bindfs_chmod(const char *path, mode_t mode)
     (void)fi;
 #endif
 
+    wait_for_op_permit(OP_CLASS_SETATTR);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1241,6 +1928,8 @@ static int bindfs_chown(const char *path, uid_t uid, gid_t gid)
     }
 
     if (uid != (uid_t)-1 || gid != (gid_t)-1) {
+        wait_for_op_permit(OP_CLASS_SETATTR);
+
         real_path = process_path(path, true);
         if (real_path == NULL)
             return -errno;
@@ -1267,10 +1956,23 @@ static int bindfs_truncate(const char *path, off_t size)
     (void)fi;
 #endif
 
+    wait_for_op_permit(OP_CLASS_SETATTR);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
 
+    if (settings.write_behind) {
+        struct stat st;
+        if (stat(real_path, &st) == 0) {
+            res = write_behind_flush_inode(st.st_dev, st.st_ino);
+            if (res != 0) {
+                free(real_path);
+                return res;
+            }
+        }
+    }
+
     res = truncate(real_path, size);
     free(real_path);
     if (res == -1)
@@ -1286,7 +1988,11 @@ static int bindfs_ftruncate(const char *path, off_t size,
     int res;
     (void) path;
 
-    res = ftruncate(fi->fh, size);
+    res = flush_write_behind(fi);
+    if (res != 0)
+        return res;
+
+    res = ftruncate(get_fd(fi), size);
     if (res == -1)
         return -errno;
 
@@ -1306,6 +2012,8 @@ static int bindfs_utimens(const char *path, const struct timespec ts[2])
     (void)fi;
 #endif
 
+    wait_for_op_permit(OP_CLASS_SETATTR);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1336,6 +2044,8 @@ static int bindfs_create(const char *path, mode_t mode, struct fuse_file_info *f
     struct fuse_context *fc;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_CREATE);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1360,8 +2070,8 @@ static int bindfs_create(const char *path, mode_t mode, struct fuse_file_info *f
     chown_new_file(real_path, fc, &chown);
     free(real_path);
 
-    fi->fh = fd;
-    return 0;
+    set_cache_mode(path, fd, fi);
+    return attach_open_file(fi, fd);
 }
 
 static int bindfs_open(const char *path, struct fuse_file_info *fi)
@@ -1369,6 +2079,23 @@ static int bindfs_open(const char *path, struct fuse_file_info *fi)
     int fd;
     char *real_path;
 
+    if (is_stats_file(path)) {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY)
+            return -EACCES;
+        if (strcmp(path, accounting_file_path) == 0) {
+            uid_t uid = fuse_get_context()->uid;
+            if (uid != getuid() && uid != 0)
+                return -EACCES;
+        }
+        fd = open_stats_snapshot(path);
+        if (fd < 0)
+            return fd;
+        fi->direct_io = 1;
+        return attach_open_file(fi, fd);
+    }
+
+    wait_for_op_permit(OP_CLASS_LOOKUP);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1378,9 +2105,6 @@ static int bindfs_open(const char *path, struct fuse_file_info *fi)
     if (!settings.forward_odirect) {
         flags &= ~O_DIRECT;
     }
-#ifndef HAVE_FUSE_3  // With FUSE 3, we set this in bindfs_init
-    fi->direct_io = settings.direct_io;
-#endif
 #endif
 
     fd = open(real_path, flags);
@@ -1388,8 +2112,8 @@ static int bindfs_open(const char *path, struct fuse_file_info *fi)
     if (fd == -1)
         return -errno;
 
-    fi->fh = fd;
-    return 0;
+    set_cache_mode(path, fd, fi);
+    return attach_open_file(fi, fd);
 }
 
 static int bindfs_read(const char *path, char *buf, size_t size, off_t offset,
@@ -1400,9 +2124,11 @@ static int bindfs_read(const char *path, char *buf, size_t size, off_t offset,
 
     char *target_buf = buf;
 
-    if (settings.read_limiter) {
-        rate_limiter_wait(settings.read_limiter, size);
-    }
+    res = flush_write_behind(fi);
+    if (res != 0)
+        return res;
+
+    wait_for_read_permit(size);
 
 #ifdef __linux__
     size_t mmap_size = 0;
@@ -1415,9 +2141,20 @@ static int bindfs_read(const char *path, char *buf, size_t size, off_t offset,
     }
 #endif
 
-    res = pread(fi->fh, target_buf, size, offset);
+    double start = settings.read_latency_limiter ? monotonic_clock() : 0;
+    BINDFS_PROBE1(source__entry, "pread");
+    res = pread(get_fd(fi), target_buf, size, offset);
+    BINDFS_PROBE2(source__exit, "pread", (int64_t)(res == -1 ? -errno : res));
+    if (settings.read_latency_limiter && res >= 0)
+        adaptive_limiter_record(settings.read_latency_limiter, monotonic_clock() - start, res);
     if (res == -1)
         res = -errno;
+    else {
+        metrics_add(METRIC_BYTES_READ, res);
+        account_bytes(res, 0);
+    }
+    if (res > 0 && settings.source_readahead)
+        readahead_note_read(&get_open_file(fi)->readahead, get_fd(fi), offset, res);
 
 #ifdef __linux__
     if (target_buf != buf) {
@@ -1436,8 +2173,16 @@ static int bindfs_write(const char *path, const char *buf, size_t size,
     (void) path;
     char *source_buf = (char*)buf;
 
-    if (settings.write_limiter) {
-        rate_limiter_wait(settings.write_limiter, size);
+    wait_for_write_permit(size);
+
+    struct write_behind *wb = get_open_file(fi)->write_behind;
+    if (wb != NULL) {
+        res = write_behind_write(wb, buf, size, offset);
+        if (res > 0) {
+            metrics_add(METRIC_BYTES_WRITTEN, res);
+            account_bytes(0, res);
+        }
+        return res;
     }
 
 #ifdef __linux__
@@ -1452,9 +2197,18 @@ static int bindfs_write(const char *path, const char *buf, size_t size,
     }
 #endif
 
-    res = pwrite(fi->fh, source_buf, size, offset);
+    double start = settings.write_latency_limiter ? monotonic_clock() : 0;
+    BINDFS_PROBE1(source__entry, "pwrite");
+    res = pwrite(get_fd(fi), source_buf, size, offset);
+    BINDFS_PROBE2(source__exit, "pwrite", (int64_t)(res == -1 ? -errno : res));
+    if (settings.write_latency_limiter && res >= 0)
+        adaptive_limiter_record(settings.write_latency_limiter, monotonic_clock() - start, res);
     if (res == -1)
         res = -errno;
+    else {
+        metrics_add(METRIC_BYTES_WRITTEN, res);
+        account_bytes(0, res);
+    }
 
 #ifdef __linux__
     if (source_buf != buf) {
@@ -1471,7 +2225,7 @@ static int bindfs_lock(const char *path, struct fuse_file_info *fi, int cmd,
                        struct flock *lock)
 {
   (void)path;
-  int res = fcntl(fi->fh, cmd, lock);
+  int res = fcntl(get_fd(fi), cmd, lock);
   if (res == -1) {
     return -errno;
   }
@@ -1482,11 +2236,48 @@ static int bindfs_lock(const char *path, struct fuse_file_info *fi, int cmd,
 static int bindfs_flock(const char *path, struct fuse_file_info *fi, int op)
 {
     (void)path;
-    int res = flock(fi->fh, op);
+    int res = flock(get_fd(fi), op);
+    if (res == -1) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int bindfs_fallocate(const char *path, int mode, off_t offset,
+                            off_t length, struct fuse_file_info *fi)
+{
+    (void)path;
+    int res;
+
+    res = flush_write_behind(fi);
+    if (res != 0) {
+        return res;
+    }
+
+    if (mode == 0) {
+#ifdef HAVE_POSIX_FALLOCATE
+        res = posix_fallocate(get_fd(fi), offset, length);
+        return -res;
+#else
+        return -EOPNOTSUPP;
+#endif
+    }
+
+    /* Other modes (keep size, punch hole, zero range, ...) are Linux-specific.
+       glibc only declares fallocate() with _GNU_SOURCE, so we make the
+       syscall directly where off_t fits in a register. */
+#if defined(__NR_fallocate) && defined(__LP64__)
+    res = syscall(__NR_fallocate, get_fd(fi), mode, offset, length);
     if (res == -1) {
         return -errno;
     }
     return 0;
+#else
+    (void)offset;
+    (void)length;
+    (void)fi;
+    return -EOPNOTSUPP;
+#endif
 }
 #endif
 
@@ -1502,8 +2293,21 @@ static int bindfs_ioctl(const char *path, int cmd, void *arg,
 {
     (void)path;
     (void)arg;
+    int fd;
+#ifdef FUSE_IOCTL_DIR
+    if (flags & FUSE_IOCTL_DIR) {
+        struct dir_reader *dr = get_dir_reader(fi);
+        if (dr == NULL)  /* The virtual .bindfs directory */
+            return -ENOTTY;
+        fd = dir_reader_fd(dr);
+    } else {
+        fd = get_fd(fi);
+    }
+#else
     (void)flags;
-    int res = ioctl(fi->fh, cmd, data);
+    fd = get_fd(fi);
+#endif
+    int res = ioctl(fd, cmd, data);
     if (res == -1) {
       return -errno;
     }
@@ -1515,6 +2319,8 @@ static int bindfs_statfs(const char *path, struct statvfs *stbuf)
     int res;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_LOOKUP);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1533,6 +2339,8 @@ static int bindfs_statfs_x(const char *path, struct statfs *stbuf)
     int res;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_LOOKUP);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1549,32 +2357,204 @@ static int bindfs_statfs_x(const char *path, struct statfs *stbuf)
 static int bindfs_release(const char *path, struct fuse_file_info *fi)
 {
     (void) path;
+    struct open_file *of = get_open_file(fi);
 
-    close(fi->fh);
+    if (of->write_behind) {
+        /* Errors were already reported by flush, if the file was closed normally. */
+        int res = write_behind_close(of->write_behind);
+        if (res != 0) {
+            DPRINTF("Failed to write buffered data on release: %s", strerror(-res));
+        }
+    }
+#ifdef PASSTHROUGH_SUPPORTED
+    if (of->backing_id > 0) {
+        passthrough_close(fuse_dev_fd, of->backing_id);
+    }
+#endif
+    if (settings.source_readahead) {
+        readahead_destroy(&of->readahead);
+    }
+    close(of->fd);
+    free(of);
 
     return 0;
 }
 
-static int bindfs_fsync(const char *path, int isdatasync,
-                        struct fuse_file_info *fi)
+static bool uses_group_commit(void)
+{
+    if (settings.sync_policy == SYNC_GROUP_COMMIT) {
+        return true;
+    }
+    for (int i = 0; i < settings.num_sync_rules; ++i) {
+        if (settings.sync_rules[i].policy == SYNC_GROUP_COMMIT) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Syncs an open file or directory according to the sync policy. */
+static int sync_file(const char *path, int fd, int isdatasync)
 {
     int res;
-    (void) path;
+    enum SyncPolicy policy = settings.sync_policy;
+
+    if (path != NULL) {
+        for (int i = 0; i < settings.num_sync_rules; ++i) {
+            if (path_matches(settings.sync_rules[i].pattern, path)) {
+                policy = settings.sync_rules[i].policy;
+                break;
+            }
+        }
+    }
+
+    switch (policy) {
+    case SYNC_IGNORE:
+        return 0;
+    case SYNC_GROUP_COMMIT:
+        return group_commit_sync(fd);
+    case SYNC_PASSTHROUGH:
+        break;
+    }
 
 #ifndef HAVE_FDATASYNC
     (void) isdatasync;
 #else
     if (isdatasync)
-        res = fdatasync(fi->fh);
+        res = fdatasync(fd);
     else
 #endif
-        res = fsync(fi->fh);
+        res = fsync(fd);
     if (res == -1)
         return -errno;
 
     return 0;
 }
 
+static int bindfs_fsync(const char *path, int isdatasync,
+                        struct fuse_file_info *fi)
+{
+    int res;
+
+    res = flush_write_behind(fi);
+    if (res != 0)
+        return res;
+
+    return sync_file(path, get_fd(fi), isdatasync);
+}
+
+static int bindfs_fsyncdir(const char *path, int isdatasync,
+                           struct fuse_file_info *fi)
+{
+    struct dir_reader *dr = get_dir_reader(fi);
+    if (dr == NULL)  /* The virtual .bindfs directory has nothing to sync. */
+        return 0;
+    return sync_file(path, dir_reader_fd(dr), isdatasync);
+}
+
+/* Called on each close(). Only installed with --write-behind. */
+static int bindfs_flush(const char *path, struct fuse_file_info *fi)
+{
+    (void) path;
+
+    return flush_write_behind(fi);
+}
+
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_COPY_FILE_RANGE
+/* Lets the source filesystem copy (or reflink) data without it passing
+   through us. The kernel falls back to reading and writing if this fails. */
+static ssize_t bindfs_copy_file_range(const char *path_in, struct fuse_file_info *fi_in,
+                                      off_t offset_in, const char *path_out,
+                                      struct fuse_file_info *fi_out, off_t offset_out,
+                                      size_t size, int flags)
+{
+    (void) path_in;
+    (void) path_out;
+
+#ifdef __NR_copy_file_range
+    ssize_t res;
+
+    res = flush_write_behind(fi_in);
+    if (res == 0) {
+        res = flush_write_behind(fi_out);
+    }
+    if (res != 0) {
+        return res;
+    }
+
+    /* The requested size can be anything up to SSIZE_MAX, so copy at most
+       one request's worth at a time and charge the rate limiters for that.
+       Callers of copy_file_range loop on short copies. */
+    size_t max_size = settings.max_write ? settings.max_write : default_request_size;
+    if (size > max_size) {
+        size = max_size;
+    }
+
+    wait_for_read_permit(size);
+    wait_for_write_permit(size);
+
+    res = syscall(__NR_copy_file_range, get_fd(fi_in), &offset_in,
+                  get_fd(fi_out), &offset_out, size, (unsigned int)flags);
+    if (res == -1)
+        return -errno;
+    metrics_add(METRIC_BYTES_READ, res);
+    metrics_add(METRIC_BYTES_WRITTEN, res);
+    account_bytes(res, res);
+
+    return res;
+#else
+    (void) fi_in;
+    (void) offset_in;
+    (void) fi_out;
+    (void) offset_out;
+    (void) size;
+    (void) flags;
+    return -ENOSYS;
+#endif
+}
+#endif
+
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_LSEEK
+/* The kernel only calls this for SEEK_DATA and SEEK_HOLE. */
+static off_t bindfs_lseek(const char *path, off_t offset, int whence,
+                          struct fuse_file_info *fi)
+{
+    (void) path;
+    off_t res;
+
+    int flush_res = flush_write_behind(fi);
+    if (flush_res != 0) {
+        return flush_res;
+    }
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    /* Block devices shown as files have no holes. */
+    if (settings.block_devices_as_files && (whence == SEEK_DATA || whence == SEEK_HOLE)) {
+        struct stat st;
+        if (fstat(get_fd(fi), &st) == -1) {
+            return -errno;
+        }
+        if (S_ISBLK(st.st_mode)) {
+            off_t size = lseek(get_fd(fi), 0, SEEK_END);
+            if (size == (off_t)-1) {
+                return -errno;
+            }
+            if (offset < 0 || offset >= size) {
+                return -ENXIO;
+            }
+            return whence == SEEK_DATA ? offset : size;
+        }
+    }
+#endif
+
+    res = lseek(get_fd(fi), offset, whence);
+    if (res == (off_t)-1) {
+        return -errno;
+    }
+    return res;
+}
+#endif
+
 #ifdef HAVE_SETXATTR
 /* The disgusting __APPLE__ sections below were copied without much
    understanding from the osxfuse example file:
@@ -1596,6 +2576,8 @@ static int bindfs_setxattr(const char *path, const char *name, const char *value
     if (settings.xattr_policy == XATTR_READ_ONLY)
         return -EACCES;
 
+    wait_for_op_permit(OP_CLASS_XATTR);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1636,6 +2618,8 @@ static int bindfs_getxattr(const char *path, const char *name, char *value,
     int res;
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_XATTR);
+
     DPRINTF("getxattr %s %s", path, name);
 
     real_path = process_path(path, true);
@@ -1666,6 +2650,8 @@ static int bindfs_listxattr(const char *path, char* list, size_t size)
 {
     char *real_path;
 
+    wait_for_op_permit(OP_CLASS_XATTR);
+
     DPRINTF("listxattr %s", path);
 
     real_path = process_path(path, true);
@@ -1721,6 +2707,8 @@ static int bindfs_removexattr(const char *path, const char *name)
     if (settings.xattr_policy == XATTR_READ_ONLY)
         return -EACCES;
 
+    wait_for_op_permit(OP_CLASS_XATTR);
+
     real_path = process_path(path, true);
     if (real_path == NULL)
         return -errno;
@@ -1747,6 +2735,257 @@ static int bindfs_removexattr(const char *path, const char *name)
 }
 #endif /* HAVE_SETXATTR */
 
+/* In serialized mode, libfuse runs multithreaded but only one operation
+   runs at a time, like in single-threaded mode. An operation gives up the
+   lock while it waits for a rate limit, so that throttled reads and writes
+   don't hold up everything else. */
+static pthread_mutex_t serial_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void release_serial_lock(void)
+{
+    if (settings.serialize_ops) {
+        pthread_mutex_unlock(&serial_lock);
+    }
+}
+
+static void reacquire_serial_lock(void)
+{
+    if (settings.serialize_ops) {
+        pthread_mutex_lock(&serial_lock);
+    }
+}
+
+/* The wrappers installed by wrap_operations. They take serial_lock in
+   serialized mode, record the operation's latency with --stats, count
+   it with --metrics and --accounting, and trace it with --trace and
+   the op__entry and op__exit probes. */
+#define WRAPPED_OP_IMPL(type, name, params, args, serialize) \
+    static int stats_id_##name = -1; \
+    static int metrics_id_##name = -1; \
+    static int trace_id_##name = -1; \
+    static type wrapped_##name params \
+    { \
+        type res; \
+        BINDFS_PROBE2(op__entry, #name, FIRST_ARG args); \
+        if (settings.trace_fd != -1) { \
+            trace_enter(trace_id_##name, FIRST_ARG args); \
+        } \
+        bool timed = settings.stats || settings.accounting; \
+        double start = timed ? monotonic_clock() : 0; \
+        if (serialize) { \
+            pthread_mutex_lock(&serial_lock); \
+        } \
+        res = bindfs_##name args; \
+        if (serialize) { \
+            pthread_mutex_unlock(&serial_lock); \
+        } \
+        if (timed) { \
+            double latency = monotonic_clock() - start; \
+            if (settings.stats) { \
+                stats_record(stats_id_##name, latency, res < 0); \
+            } \
+            if (settings.accounting) { \
+                account_op(latency); \
+            } \
+        } \
+        if (settings.metrics) { \
+            metrics_count_op(metrics_id_##name, res < 0); \
+        } \
+        if (settings.trace_fd != -1) { \
+            trace_exit(trace_id_##name, res); \
+        } \
+        BINDFS_PROBE2(op__exit, #name, (int64_t)res); \
+        return res; \
+    }
+/* The first argument, which is the path for all operations. */
+#define FIRST_ARG(...) FIRST_ARG_IMPL(__VA_ARGS__, unused)
+#define FIRST_ARG_IMPL(first, ...) first
+#define WRAPPED_OP(type, name, params, args) \
+    WRAPPED_OP_IMPL(type, name, params, args, settings.serialize_ops)
+/* Locking operations are never serialized, since they may block indefinitely. */
+#define UNSERIALIZED_OP(type, name, params, args) \
+    WRAPPED_OP_IMPL(type, name, params, args, 0)
+
+#ifdef HAVE_FUSE_3
+WRAPPED_OP(int, getattr, (const char *path, struct stat *stbuf, struct fuse_file_info *fi),
+           (path, stbuf, fi))
+#else
+WRAPPED_OP(int, getattr, (const char *path, struct stat *stbuf), (path, stbuf))
+WRAPPED_OP(int, fgetattr, (const char *path, struct stat *stbuf, struct fuse_file_info *fi),
+           (path, stbuf, fi))
+#endif
+WRAPPED_OP(int, readlink, (const char *path, char *buf, size_t size), (path, buf, size))
+WRAPPED_OP(int, opendir, (const char *path, struct fuse_file_info *fi), (path, fi))
+#ifdef HAVE_FUSE_3
+WRAPPED_OP(int, readdir, (const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+                          struct fuse_file_info *fi, enum fuse_readdir_flags flags),
+           (path, buf, filler, offset, fi, flags))
+#else
+WRAPPED_OP(int, readdir, (const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+                          struct fuse_file_info *fi),
+           (path, buf, filler, offset, fi))
+#endif
+WRAPPED_OP(int, releasedir, (const char *path, struct fuse_file_info *fi), (path, fi))
+WRAPPED_OP(int, mknod, (const char *path, mode_t mode, dev_t rdev), (path, mode, rdev))
+WRAPPED_OP(int, mkdir, (const char *path, mode_t mode), (path, mode))
+WRAPPED_OP(int, symlink, (const char *from, const char *to), (from, to))
+WRAPPED_OP(int, unlink, (const char *path), (path))
+WRAPPED_OP(int, rmdir, (const char *path), (path))
+#ifdef HAVE_FUSE_3
+WRAPPED_OP(int, rename, (const char *from, const char *to, unsigned int flags), (from, to, flags))
+#else
+WRAPPED_OP(int, rename, (const char *from, const char *to), (from, to))
+#endif
+WRAPPED_OP(int, link, (const char *from, const char *to), (from, to))
+#ifdef HAVE_FUSE_3
+WRAPPED_OP(int, chmod, (const char *path, mode_t mode, struct fuse_file_info *fi), (path, mode, fi))
+WRAPPED_OP(int, chown, (const char *path, uid_t uid, gid_t gid, struct fuse_file_info *fi),
+           (path, uid, gid, fi))
+WRAPPED_OP(int, truncate, (const char *path, off_t size, struct fuse_file_info *fi), (path, size, fi))
+WRAPPED_OP(int, utimens, (const char *path, const struct timespec tv[2], struct fuse_file_info *fi),
+           (path, tv, fi))
+#else
+WRAPPED_OP(int, chmod, (const char *path, mode_t mode), (path, mode))
+WRAPPED_OP(int, chown, (const char *path, uid_t uid, gid_t gid), (path, uid, gid))
+WRAPPED_OP(int, truncate, (const char *path, off_t size), (path, size))
+WRAPPED_OP(int, ftruncate, (const char *path, off_t size, struct fuse_file_info *fi), (path, size, fi))
+WRAPPED_OP(int, utimens, (const char *path, const struct timespec tv[2]), (path, tv))
+#endif
+WRAPPED_OP(int, create, (const char *path, mode_t mode, struct fuse_file_info *fi), (path, mode, fi))
+WRAPPED_OP(int, open, (const char *path, struct fuse_file_info *fi), (path, fi))
+WRAPPED_OP(int, read, (const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi),
+           (path, buf, size, offset, fi))
+WRAPPED_OP(int, write, (const char *path, const char *buf, size_t size, off_t offset,
+                        struct fuse_file_info *fi),
+           (path, buf, size, offset, fi))
+#if defined(HAVE_FUSE_29) || defined(HAVE_FUSE_3)
+WRAPPED_OP(int, fallocate, (const char *path, int mode, off_t offset, off_t length,
+                            struct fuse_file_info *fi),
+           (path, mode, offset, length, fi))
+#endif
+#ifndef __OpenBSD__
+WRAPPED_OP(int, ioctl, (const char *path, int cmd, void *arg, struct fuse_file_info *fi,
+                        unsigned int flags, void *data),
+           (path, cmd, arg, fi, flags, data))
+#endif
+WRAPPED_OP(int, statfs, (const char *path, struct statvfs *stbuf), (path, stbuf))
+#ifdef HAVE_FUSE_T
+WRAPPED_OP(int, statfs_x, (const char *path, struct statfs *stbuf), (path, stbuf))
+#endif
+WRAPPED_OP(int, release, (const char *path, struct fuse_file_info *fi), (path, fi))
+WRAPPED_OP(int, fsync, (const char *path, int isdatasync, struct fuse_file_info *fi),
+           (path, isdatasync, fi))
+WRAPPED_OP(int, fsyncdir, (const char *path, int isdatasync, struct fuse_file_info *fi),
+           (path, isdatasync, fi))
+WRAPPED_OP(int, flush, (const char *path, struct fuse_file_info *fi), (path, fi))
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_COPY_FILE_RANGE
+WRAPPED_OP(ssize_t, copy_file_range, (const char *path_in, struct fuse_file_info *fi_in,
+                                      off_t offset_in, const char *path_out,
+                                      struct fuse_file_info *fi_out, off_t offset_out,
+                                      size_t size, int flags),
+           (path_in, fi_in, offset_in, path_out, fi_out, offset_out, size, flags))
+#endif
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_LSEEK
+WRAPPED_OP(off_t, lseek, (const char *path, off_t offset, int whence, struct fuse_file_info *fi),
+           (path, offset, whence, fi))
+#endif
+#ifdef HAVE_SETXATTR
+#ifdef HAVE_FUSE_T
+WRAPPED_OP(int, setxattr, (const char *path, const char *name, const char *value, size_t size,
+                           int flags, uint32_t position),
+           (path, name, value, size, flags, position))
+WRAPPED_OP(int, getxattr, (const char *path, const char *name, char *value, size_t size,
+                           uint32_t position),
+           (path, name, value, size, position))
+#else
+WRAPPED_OP(int, setxattr, (const char *path, const char *name, const char *value, size_t size,
+                           int flags),
+           (path, name, value, size, flags))
+WRAPPED_OP(int, getxattr, (const char *path, const char *name, char *value, size_t size),
+           (path, name, value, size))
+#endif
+WRAPPED_OP(int, listxattr, (const char *path, char *list, size_t size), (path, list, size))
+WRAPPED_OP(int, removexattr, (const char *path, const char *name), (path, name))
+#endif
+#if defined(HAVE_FUSE_29) || defined(HAVE_FUSE_3)
+UNSERIALIZED_OP(int, lock, (const char *path, struct fuse_file_info *fi, int cmd, struct flock *lock),
+                (path, fi, cmd, lock))
+UNSERIALIZED_OP(int, flock, (const char *path, struct fuse_file_info *fi, int op), (path, fi, op))
+#endif
+
+/* Replaces the operations in `oper` with the wrappers above. */
+static void wrap_operations(struct fuse_operations *oper)
+{
+#define WRAP(name) \
+    if (oper->name) { \
+        if (settings.stats) { \
+            stats_id_##name = stats_register_op(#name); \
+        } \
+        if (settings.metrics) { \
+            metrics_id_##name = metrics_register_op(#name); \
+        } \
+        if (settings.trace_fd != -1) { \
+            trace_id_##name = trace_register_op(#name); \
+        } \
+        oper->name = wrapped_##name; \
+    }
+    WRAP(getattr);
+#ifndef HAVE_FUSE_3
+    WRAP(fgetattr);
+    WRAP(ftruncate);
+#endif
+    WRAP(readlink);
+    WRAP(opendir);
+    WRAP(readdir);
+    WRAP(releasedir);
+    WRAP(mknod);
+    WRAP(mkdir);
+    WRAP(symlink);
+    WRAP(unlink);
+    WRAP(rmdir);
+    WRAP(rename);
+    WRAP(link);
+    WRAP(chmod);
+    WRAP(chown);
+    WRAP(truncate);
+    WRAP(utimens);
+    WRAP(create);
+    WRAP(open);
+    WRAP(read);
+    WRAP(write);
+#if defined(HAVE_FUSE_29) || defined(HAVE_FUSE_3)
+    WRAP(fallocate);
+#endif
+#ifndef __OpenBSD__
+    WRAP(ioctl);
+#endif
+    WRAP(statfs);
+#ifdef HAVE_FUSE_T
+    WRAP(statfs_x);
+#endif
+    WRAP(release);
+    WRAP(fsync);
+    WRAP(fsyncdir);
+    WRAP(flush);
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_COPY_FILE_RANGE
+    WRAP(copy_file_range);
+#endif
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_LSEEK
+    WRAP(lseek);
+#endif
+#ifdef HAVE_SETXATTR
+    WRAP(setxattr);
+    WRAP(getxattr);
+    WRAP(listxattr);
+    WRAP(removexattr);
+#endif
+#if defined(HAVE_FUSE_29) || defined(HAVE_FUSE_3)
+    WRAP(lock);
+    WRAP(flock);
+#endif
+#undef WRAP
+}
+
 
 static struct fuse_operations bindfs_oper = {
     .init       = bindfs_init,
@@ -1757,7 +2996,9 @@ static struct fuse_operations bindfs_oper = {
     #endif
     /* no access() since we always use -o default_permissions */
     .readlink   = bindfs_readlink,
+    .opendir    = bindfs_opendir,
     .readdir    = bindfs_readdir,
+    .releasedir = bindfs_releasedir,
     .mknod      = bindfs_mknod,
     .mkdir      = bindfs_mkdir,
     .symlink    = bindfs_symlink,
@@ -1779,6 +3020,7 @@ static struct fuse_operations bindfs_oper = {
 #if defined(HAVE_FUSE_29) || defined(HAVE_FUSE_3)
     .lock       = bindfs_lock,
     .flock      = bindfs_flock,
+    .fallocate  = bindfs_fallocate,
 #endif
 #ifndef __OpenBSD__
     .ioctl      = bindfs_ioctl,
@@ -1789,6 +3031,14 @@ static struct fuse_operations bindfs_oper = {
 #endif
     .release    = bindfs_release,
     .fsync      = bindfs_fsync,
+    .fsyncdir   = bindfs_fsyncdir,
+    .flush      = bindfs_flush,
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_COPY_FILE_RANGE
+    .copy_file_range = bindfs_copy_file_range,
+#endif
+#ifdef HAVE_STRUCT_FUSE_OPERATIONS_LSEEK
+    .lseek      = bindfs_lseek,
+#endif
 #ifdef HAVE_SETXATTR
     .setxattr   = bindfs_setxattr,
     .getxattr   = bindfs_getxattr,
@@ -1860,12 +3110,40 @@ static void print_usage(const char *progname)
            "Other file operations:\n"
            "  --delete-deny             Disallow deleting files.\n"
            "  --rename-deny             Disallow renaming files (within the mount).\n"
-           "\n"
-           "Rate limits:\n"
+           "\n",
+           progname);
+    printf("Rate limits:\n"
            "  --read-rate=...           Limit to bytes/sec that can be read.\n"
            "  --write-rate=...          Limit to bytes/sec that can be written.\n"
+           "  --read-rate-per-user=...  Limit to bytes/sec that each user can read.\n"
+           "  --write-rate-per-user=... Limit to bytes/sec that each user can write.\n"
+           "  --rate-limit-by=uid|gid   Apply per-user limits per user or per group.\n"
+           "  --shared-rate-limit=NAME  Share the rates below with other mounts.\n"
+           "  --shared-read-rate=...    Limit to bytes/sec read by all sharing mounts.\n"
+           "  --shared-write-rate=...   Limit to bytes/sec written by all sharing mounts.\n"
+           "  --fair-queue              Share --read-rate/--write-rate fairly by user.\n"
+           "  --fair-queue-weights=...  Relative shares: user=weight:...\n"
+           "  --op-rate=class=N:...     Limit to operations/sec of each class.\n"
+           "  --op-rate-per-user=...    Limit to operations/sec of each class per user.\n"
+           "  --rate-burst=...          Seconds of unused rate that may be used at once.\n"
+           "  --rate-config=FILE        Read rates from FILE. Reloaded on SIGUSR2.\n"
+           "  --latency-target=MS       Slow down I/O to keep the source's p99 latency\n"
+           "                            under MS milliseconds.\n"
+           "\n"
+           "I/O tuning:\n"
+           "  --max-write=...           Largest write request from the kernel.\n"
+           "  --max-read=...            Largest read request from the kernel.\n"
+           "  --max-readahead=...       Limit kernel readahead.\n"
+           "  --source-readahead=...    Hint the source FS to read ahead of sequential\n"
+           "                            readers, up to this many bytes.\n"
+           "  --write-behind=...        Buffer up to this many bytes of writes per file.\n"
            "\n"
-           "Miscellaneous:\n"
+           "Durability:\n"
+           "  --sync-policy=...         passthrough, ignore or group-commit for fsync().\n"
+           "  --sync-policy-rules=...   Per-path sync policies: pattern=policy:...\n"
+           "  --sync-interval=...       Milliseconds to collect fsyncs for group commit.\n"
+           "\n");
+    printf("Miscellaneous:\n"
            "  --no-allow-other          Do not add -o allow_other to fuse options.\n"
            "  --realistic-permissions   Hide permission bits for actions mounter can't do.\n"
            "  --ctime-from-mtime        Read file properties' change time\n"
@@ -1879,6 +3157,18 @@ static void print_usage(const char *progname)
            "  --multithreaded           Enable multithreaded mode. See man page\n"
            "                            for security issue with current implementation.\n"
            "  --forward-odirect=...     Forward O_DIRECT (it's cleared by default).\n"
+           "  --direct-io-paths=...     Use direct I/O for files matching these patterns.\n"
+           "  --direct-io-min-size=...  Use direct I/O for files at least this large.\n"
+           "  --direct-io-flags=...     Use direct I/O for opens with these flags.\n"
+           "  --keep-cache              Keep cached file contents between opens.\n"
+           "  --passthrough             Let the kernel do file I/O directly on the\n"
+           "                            source files (Linux 6.9+). *\n"
+           "  --stats                   Show operation latencies in /.bindfs/stats.\n"
+           "  --metrics=NAME            Publish counters for bindfs-stat under NAME.\n"
+           "  --accounting=uid|pid      Show usage per user or per process\n"
+           "                            in /.bindfs/accounting.\n"
+           "  --trace=FILE              Write a binary trace of operations to FILE.\n"
+           "  --trace-max-size=...      Stop tracing when the file reaches this size.\n"
            "\n"
            "FUSE options:\n"
            "  -o opt[,opt,...]          Mount options.\n"
@@ -1887,8 +3177,7 @@ static void print_usage(const char *progname)
            "  -f                        Foreground operation.\n"
            "\n"
            "(*: root only)\n"
-           "\n",
-           progname);
+           "\n");
 }
 
 
@@ -1924,7 +3213,11 @@ enum OptionKey {
     OPTKEY_RESOLVE_SYMLINKS,
     OPTKEY_BLOCK_DEVICES_AS_FILES,
     OPTKEY_DIRECT_IO,
-    OPTKEY_NO_DIRECT_IO
+    OPTKEY_NO_DIRECT_IO,
+    OPTKEY_PASSTHROUGH,
+    OPTKEY_KEEP_CACHE,
+    OPTKEY_FAIR_QUEUE,
+    OPTKEY_STATS
 };
 
 static int process_option(void *data, const char *arg, int key,
@@ -2042,6 +3335,18 @@ static int process_option(void *data, const char *arg, int key,
         settings.direct_io = false;
         return 0;
 #endif
+    case OPTKEY_PASSTHROUGH:
+        settings.passthrough = 1;
+        return 0;
+    case OPTKEY_KEEP_CACHE:
+        settings.keep_cache = 1;
+        return 0;
+    case OPTKEY_STATS:
+        settings.stats = 1;
+        return 0;
+    case OPTKEY_FAIR_QUEUE:
+        settings.fair_queue = 1;
+        return 0;
     case OPTKEY_NONOPTION:
         if (!settings.mntsrc) {
             if (strncmp(arg, "/proc/", strlen("/proc/")) == 0) {
@@ -2340,6 +3645,347 @@ static void maybe_stdout_stderr_to_file(void)
 #endif
 }
 
+/* Returns 1 on success, 0 on syntax error or if out of range. */
+static int parse_request_size(const char *str, size_t *result)
+{
+    double size;
+    if (!parse_byte_count(str, &size) || size < 1 || size > UINT32_MAX) {
+        return 0;
+    }
+    *result = (size_t)size;
+    return 1;
+}
+
+/* Returns 1 on success, 0 on an unknown policy. */
+static int parse_sync_policy(const char *str, enum SyncPolicy *result)
+{
+    if (strcmp(str, "passthrough") == 0) {
+        *result = SYNC_PASSTHROUGH;
+    } else if (strcmp(str, "ignore") == 0) {
+        *result = SYNC_IGNORE;
+    } else if (strcmp(str, "group-commit") == 0) {
+        *result = SYNC_GROUP_COMMIT;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/* Parses "pattern=policy:pattern=policy:...".
+   Returns 1 on success, 0 on syntax error. */
+static int parse_sync_rules(const char *spec)
+{
+    const char *p = spec;
+
+    settings.num_sync_rules = count_chars(spec, ':') + 1;
+    settings.sync_rules = calloc(settings.num_sync_rules, sizeof(struct SyncRule));
+    for (int i = 0; i < settings.num_sync_rules; ++i) {
+        char *rule = strdup_until(p, ":");
+        p += strlen(rule);
+        if (*p == ':') {
+            ++p;
+        }
+
+        char *eq = strrchr(rule, '=');
+        if (eq == NULL || eq == rule) {
+            free(rule);
+            return 0;
+        }
+        *eq = '\0';
+        settings.sync_rules[i].pattern = rule;
+        if (!parse_sync_policy(eq + 1, &settings.sync_rules[i].policy)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Parses "class=N:class=N:..." into settings.op_limiters, or into
+   settings.user_op_limiters if `per_user`.
+   Returns 1 on success, 0 on syntax error. */
+static int parse_op_rates(const char *spec, int per_user)
+{
+    const char *p = spec;
+
+    while (*p != '\0') {
+        char *item = strdup_until(p, ":");
+        p += strlen(item);
+        if (*p == ':') {
+            ++p;
+        }
+
+        char *eq = strchr(item, '=');
+        if (eq == NULL) {
+            free(item);
+            return 0;
+        }
+        *eq = '\0';
+
+        char *endptr;
+        double rate = strtod(eq + 1, &endptr);
+        int op_class = 0;
+        while (op_class < NUM_OP_CLASSES && strcmp(item, op_class_names[op_class]) != 0) {
+            ++op_class;
+        }
+        if (op_class == NUM_OP_CLASSES || eq[1] == '\0' || *endptr != '\0' || !(rate > 0)) {
+            free(item);
+            return 0;
+        }
+        free(item);
+
+        if (per_user) {
+            if (settings.user_op_limiters[op_class] == NULL) {
+                settings.user_op_limiters[op_class] = rate_limiter_table_create(rate, &monotonic_clock);
+            }
+        } else if (settings.op_limiters[op_class] == NULL) {
+            settings.op_limiters[op_class] = malloc(sizeof(RateLimiter));
+            rate_limiter_init(settings.op_limiters[op_class], rate, &monotonic_clock);
+        }
+    }
+
+    return 1;
+}
+
+/* Parses "user=weight:user=weight:..." (or groups with --rate-limit-by=gid).
+   Returns 1 on success, 0 on syntax error or unknown user. */
+static int parse_fair_queue_weights(const char *spec)
+{
+    const char *p = spec;
+
+    while (*p != '\0') {
+        char *item = strdup_until(p, ":");
+        p += strlen(item);
+        if (*p == ':') {
+            ++p;
+        }
+
+        char *eq = strrchr(item, '=');
+        if (eq == NULL || eq == item) {
+            free(item);
+            return 0;
+        }
+        *eq = '\0';
+
+        char *endptr;
+        double weight = strtod(eq + 1, &endptr);
+        unsigned int key;
+        int ok;
+        if (settings.rate_limit_by_gid) {
+            gid_t gid;
+            ok = group_gid(item, &gid);
+            key = gid;
+        } else {
+            uid_t uid;
+            ok = user_uid(item, &uid);
+            key = uid;
+        }
+        if (!ok) {
+            fprintf(stderr, "Not a valid %s: %s\n", settings.rate_limit_by_gid ? "group" : "user", item);
+        }
+        ok = ok && eq[1] != '\0' && *endptr == '\0' && weight > 0;
+        free(item);
+        if (!ok) {
+            return 0;
+        }
+
+        if (settings.read_queue && fair_queue_set_weight(settings.read_queue, key, weight) != 0) {
+            return 0;
+        }
+        if (settings.write_queue && fair_queue_set_weight(settings.write_queue, key, weight) != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* The settings in a --rate-config file. Negative if not given. */
+struct RateConfig {
+    double read_rate;
+    double write_rate;
+    double read_rate_per_user;
+    double write_rate_per_user;
+    double shared_rates[NUM_SHARED_BUCKETS];
+    double burst;
+};
+
+static int parse_rate_config_line(struct RateConfig *config, char *line)
+{
+    char *p = strchr(line, '#');
+    if (p) {
+        *p = '\0';
+    }
+    char *key = line;
+    while (isspace((unsigned char)*key)) {
+        ++key;
+    }
+    p = key + strlen(key);
+    while (p > key && isspace((unsigned char)p[-1])) {
+        *--p = '\0';
+    }
+    if (*key == '\0') {
+        return 1;
+    }
+
+    char *value = strchr(key, '=');
+    if (value == NULL) {
+        return 0;
+    }
+    p = value;
+    while (p > key && isspace((unsigned char)p[-1])) {
+        --p;
+    }
+    *p = '\0';
+    ++value;
+    while (isspace((unsigned char)*value)) {
+        ++value;
+    }
+
+    double *target;
+    if (strcmp(key, "read-rate") == 0) {
+        target = &config->read_rate;
+    } else if (strcmp(key, "write-rate") == 0) {
+        target = &config->write_rate;
+    } else if (strcmp(key, "read-rate-per-user") == 0) {
+        target = &config->read_rate_per_user;
+    } else if (strcmp(key, "write-rate-per-user") == 0) {
+        target = &config->write_rate_per_user;
+    } else if (strcmp(key, "shared-read-rate") == 0) {
+        target = &config->shared_rates[SHARED_BUCKET_READ];
+    } else if (strcmp(key, "shared-write-rate") == 0) {
+        target = &config->shared_rates[SHARED_BUCKET_WRITE];
+    } else if (strcmp(key, "rate-burst") == 0) {
+        char *endptr;
+        config->burst = strtod(value, &endptr);
+        return *value != '\0' && *endptr == '\0' && config->burst >= 0 && config->burst <= 60;
+    } else {
+        return 0;
+    }
+    return parse_byte_count(value, target) && *target > 0;
+}
+
+/* Reads and applies a --rate-config file. The file may only change limits
+   that were enabled on the command line. Nothing is changed if there is
+   an error. */
+static int load_rate_config(const char *path)
+{
+    struct RateConfig config = { -1, -1, -1, -1, { -1, -1 }, -1 };
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open rate config %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    char line[1024];
+    int line_num = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        ++line_num;
+        ok = parse_rate_config_line(&config, line);
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Invalid rate config %s on line %d.\n", path, line_num);
+        return 0;
+    }
+
+    const char *missing = NULL;
+    if (config.read_rate > 0 && !settings.read_limiter) {
+        missing = "--read-rate";
+    } else if (config.write_rate > 0 && !settings.write_limiter) {
+        missing = "--write-rate";
+    } else if (config.read_rate_per_user > 0 && !settings.user_read_limiters) {
+        missing = "--read-rate-per-user";
+    } else if (config.write_rate_per_user > 0 && !settings.user_write_limiters) {
+        missing = "--write-rate-per-user";
+    } else if (config.shared_rates[SHARED_BUCKET_READ] > 0 && settings.shared_rates[SHARED_BUCKET_READ] == 0) {
+        missing = "--shared-read-rate";
+    } else if (config.shared_rates[SHARED_BUCKET_WRITE] > 0 && settings.shared_rates[SHARED_BUCKET_WRITE] == 0) {
+        missing = "--shared-write-rate";
+    }
+    if (missing) {
+        fprintf(stderr, "Rate config %s sets a limit not enabled with %s.\n", path, missing);
+        return 0;
+    }
+
+    if (config.read_rate > 0) {
+        rate_limiter_set_rate(settings.read_limiter, config.read_rate);
+    }
+    if (config.write_rate > 0) {
+        rate_limiter_set_rate(settings.write_limiter, config.write_rate);
+    }
+    if (config.read_rate_per_user > 0) {
+        rate_limiter_table_set_rate(settings.user_read_limiters, config.read_rate_per_user);
+    }
+    if (config.write_rate_per_user > 0) {
+        rate_limiter_table_set_rate(settings.user_write_limiters, config.write_rate_per_user);
+    }
+    for (int i = 0; i < NUM_SHARED_BUCKETS; ++i) {
+        if (config.shared_rates[i] > 0) {
+            __atomic_store(&settings.shared_rates[i], &config.shared_rates[i], __ATOMIC_RELAXED);
+        }
+    }
+    if (config.burst >= 0) {
+        rate_limiter_set_idle_credit(-config.burst);
+    }
+    return 1;
+}
+
+#ifdef __linux__
+/* Returns 1 on success, 0 if out of memory. */
+static int parse_direct_io_paths(const char *spec)
+{
+    const char *p = spec;
+    int count = count_chars(spec, ':') + 1;
+
+    settings.direct_io_patterns = calloc(count, sizeof(char *));
+    if (settings.direct_io_patterns == NULL) {
+        return 0;
+    }
+    settings.num_direct_io_patterns = count;
+    for (int i = 0; i < count; ++i) {
+        settings.direct_io_patterns[i] = strdup_until(p, ":");
+        p += strlen(settings.direct_io_patterns[i]);
+        if (*p == ':') {
+            ++p;
+        }
+    }
+    return 1;
+}
+
+/* Returns 1 on success, 0 on an unknown flag. */
+static int parse_direct_io_flags(const char *spec)
+{
+    const char *p = spec;
+    int ok = 1;
+
+    while (ok) {
+        char *flag = strdup_until(p, ":");
+        if (strcmp(flag, "odirect") == 0) {
+            settings.direct_io_flags |= DIRECT_IO_ON_ODIRECT;
+        } else if (strcmp(flag, "append") == 0) {
+            settings.direct_io_flags |= DIRECT_IO_ON_APPEND;
+        } else if (strcmp(flag, "wronly") == 0) {
+            settings.direct_io_flags |= DIRECT_IO_ON_WRONLY;
+        } else if (strcmp(flag, "sync") == 0) {
+            settings.direct_io_flags |= DIRECT_IO_ON_SYNC;
+        } else {
+            ok = 0;
+        }
+        p += strlen(flag);
+        free(flag);
+
+        if (*p != ':') {
+            break;
+        }
+        ++p;
+    }
+
+    return ok;
+}
+#endif
+
 static char *get_working_dir(void)
 {
     size_t buf_size = 4096;
@@ -2359,12 +4005,18 @@ static void setup_signal_handling(void)
     sa.sa_flags = 0;
 
     sigaction(SIGUSR1, &sa, NULL);
+    if (settings.rate_config) {
+        sigaction(SIGUSR2, &sa, NULL);
+    }
 }
 
 static void signal_handler(int sig)
 {
-    (void)sig;
-    invalidate_user_cache();
+    if (sig == SIGUSR2) {
+        rate_config_reload_requested = 1;
+    } else {
+        invalidate_user_cache();
+    }
 }
 
 static void atexit_func(void)
@@ -2373,6 +4025,32 @@ static void atexit_func(void)
     free(settings.mntdest);
     free(settings.original_working_dir);
     settings.original_working_dir = NULL;
+    free(settings.rate_config);
+    settings.rate_config = NULL;
+    if (settings.shared_limiter) {
+        shared_limiter_close(settings.shared_limiter);
+        settings.shared_limiter = NULL;
+    }
+    if (settings.metrics) {
+        metrics_close();
+        settings.metrics = 0;
+    }
+    if (settings.accounting) {
+        accounting_free();
+        settings.accounting = 0;
+    }
+    if (settings.trace_fd != -1) {
+        close(settings.trace_fd);
+        settings.trace_fd = -1;
+    }
+    if (settings.read_queue) {
+        fair_queue_destroy(settings.read_queue);
+        settings.read_queue = NULL;
+    }
+    if (settings.write_queue) {
+        fair_queue_destroy(settings.write_queue);
+        settings.write_queue = NULL;
+    }
     if (settings.read_limiter) {
         rate_limiter_destroy(settings.read_limiter);
         free(settings.read_limiter);
@@ -2383,6 +4061,33 @@ static void atexit_func(void)
         free(settings.write_limiter);
         settings.write_limiter = NULL;
     }
+    if (settings.read_latency_limiter) {
+        adaptive_limiter_destroy(settings.read_latency_limiter);
+        settings.read_latency_limiter = NULL;
+    }
+    if (settings.write_latency_limiter) {
+        adaptive_limiter_destroy(settings.write_latency_limiter);
+        settings.write_latency_limiter = NULL;
+    }
+    if (settings.user_read_limiters) {
+        rate_limiter_table_destroy(settings.user_read_limiters);
+        settings.user_read_limiters = NULL;
+    }
+    if (settings.user_write_limiters) {
+        rate_limiter_table_destroy(settings.user_write_limiters);
+        settings.user_write_limiters = NULL;
+    }
+    for (int i = 0; i < NUM_OP_CLASSES; ++i) {
+        if (settings.op_limiters[i]) {
+            rate_limiter_destroy(settings.op_limiters[i]);
+            free(settings.op_limiters[i]);
+            settings.op_limiters[i] = NULL;
+        }
+        if (settings.user_op_limiters[i]) {
+            rate_limiter_table_destroy(settings.user_op_limiters[i]);
+            settings.user_op_limiters[i] = NULL;
+        }
+    }
     usermap_destroy(settings.usermap);
     settings.usermap = NULL;
     usermap_destroy(settings.usermap_reverse);
@@ -2397,6 +4102,14 @@ static void atexit_func(void)
     settings.mirrored_users = NULL;
     free(settings.mirrored_members);
     settings.mirrored_members = NULL;
+#ifdef __linux__
+    for (int i = 0; i < settings.num_direct_io_patterns; ++i) {
+        free(settings.direct_io_patterns[i]);
+    }
+    free(settings.direct_io_patterns);
+    settings.direct_io_patterns = NULL;
+    settings.num_direct_io_patterns = 0;
+#endif
 }
 
 struct fuse_args filter_special_opts(struct fuse_args *args)
@@ -2461,6 +4174,33 @@ int main(int argc, char *argv[])
         char *map_group_rev;
         char *read_rate;
         char *write_rate;
+        char *read_rate_per_user;
+        char *write_rate_per_user;
+        char *rate_limit_by;
+        char *op_rate;
+        char *fair_queue_weights;
+        char *shared_rate_limit;
+        char *shared_read_rate;
+        char *shared_write_rate;
+        char *op_rate_per_user;
+        char *rate_burst;
+        char *rate_config;
+        char *latency_target;
+        char *metrics;
+        char *accounting;
+        char *trace;
+        char *trace_max_size;
+        char *max_write;
+        char *max_read;
+        char *max_readahead;
+        char *direct_io_paths;
+        char *direct_io_min_size;
+        char *direct_io_flags;
+        char *source_readahead;
+        char *write_behind;
+        char *sync_policy;
+        char *sync_policy_rules;
+        char *sync_interval;
         char *create_for_user;
         char *create_for_group;
         char *create_with_perms;
@@ -2509,6 +4249,19 @@ int main(int argc, char *argv[])
 
         OPT_OFFSET2("--read-rate=%s", "read-rate=%s", read_rate, -1),
         OPT_OFFSET2("--write-rate=%s", "write-rate=%s", write_rate, -1),
+        OPT_OFFSET2("--read-rate-per-user=%s", "read-rate-per-user=%s", read_rate_per_user, -1),
+        OPT_OFFSET2("--write-rate-per-user=%s", "write-rate-per-user=%s", write_rate_per_user, -1),
+        OPT_OFFSET2("--rate-limit-by=%s", "rate-limit-by=%s", rate_limit_by, -1),
+        OPT_OFFSET2("--op-rate=%s", "op-rate=%s", op_rate, -1),
+        OPT2("--fair-queue", "fair-queue", OPTKEY_FAIR_QUEUE),
+        OPT_OFFSET2("--shared-rate-limit=%s", "shared-rate-limit=%s", shared_rate_limit, -1),
+        OPT_OFFSET2("--shared-read-rate=%s", "shared-read-rate=%s", shared_read_rate, -1),
+        OPT_OFFSET2("--shared-write-rate=%s", "shared-write-rate=%s", shared_write_rate, -1),
+        OPT_OFFSET2("--fair-queue-weights=%s", "fair-queue-weights=%s", fair_queue_weights, -1),
+        OPT_OFFSET2("--op-rate-per-user=%s", "op-rate-per-user=%s", op_rate_per_user, -1),
+        OPT_OFFSET2("--rate-burst=%s", "rate-burst=%s", rate_burst, -1),
+        OPT_OFFSET2("--rate-config=%s", "rate-config=%s", rate_config, -1),
+        OPT_OFFSET2("--latency-target=%s", "latency-target=%s", latency_target, -1),
 
         OPT2("--create-as-user", "create-as-user", OPTKEY_CREATE_AS_USER),
         OPT2("--create-as-mounter", "create-as-mounter", OPTKEY_CREATE_AS_MOUNTER),
@@ -2539,7 +4292,25 @@ int main(int argc, char *argv[])
 #ifdef __linux__
         OPT2("--direct-io", "direct-io", OPTKEY_DIRECT_IO),
         OPT2("--no-direct-io", "no-direct-io", OPTKEY_NO_DIRECT_IO),
+        OPT_OFFSET2("--direct-io-paths=%s", "direct-io-paths=%s", direct_io_paths, -1),
+        OPT_OFFSET2("--direct-io-min-size=%s", "direct-io-min-size=%s", direct_io_min_size, -1),
+        OPT_OFFSET2("--direct-io-flags=%s", "direct-io-flags=%s", direct_io_flags, -1),
 #endif
+        OPT2("--keep-cache", "keep-cache", OPTKEY_KEEP_CACHE),
+        OPT_OFFSET2("--source-readahead=%s", "source-readahead=%s", source_readahead, -1),
+        OPT_OFFSET2("--write-behind=%s", "write-behind=%s", write_behind, -1),
+        OPT_OFFSET2("--sync-policy=%s", "sync-policy=%s", sync_policy, -1),
+        OPT_OFFSET2("--sync-policy-rules=%s", "sync-policy-rules=%s", sync_policy_rules, -1),
+        OPT_OFFSET2("--sync-interval=%s", "sync-interval=%s", sync_interval, -1),
+        OPT2("--passthrough", "passthrough", OPTKEY_PASSTHROUGH),
+        OPT2("--stats", "stats", OPTKEY_STATS),
+        OPT_OFFSET2("--metrics=%s", "metrics=%s", metrics, -1),
+        OPT_OFFSET2("--accounting=%s", "accounting=%s", accounting, -1),
+        OPT_OFFSET2("--trace=%s", "trace=%s", trace, -1),
+        OPT_OFFSET2("--trace-max-size=%s", "trace-max-size=%s", trace_max_size, -1),
+        OPT_OFFSET2("--max-write=%s", "max-write=%s", max_write, -1),
+        OPT_OFFSET2("--max-read=%s", "max-read=%s", max_read, -1),
+        OPT_OFFSET2("--max-readahead=%s", "max-readahead=%s", max_readahead, -1),
 
         OPT2("--hide-hard-links", "hide-hard-links", OPTKEY_HIDE_HARD_LINKS),
         OPT2("--resolve-symlinks", "resolve-symlinks", OPTKEY_RESOLVE_SYMLINKS),
@@ -2571,6 +4342,23 @@ int main(int argc, char *argv[])
     settings.usermap_reverse = usermap_create();
     settings.read_limiter = NULL;
     settings.write_limiter = NULL;
+    settings.user_read_limiters = NULL;
+    settings.user_write_limiters = NULL;
+    settings.rate_limit_by_gid = 0;
+    settings.fair_queue = 0;
+    settings.shared_limiter = NULL;
+    for (int i = 0; i < NUM_SHARED_BUCKETS; ++i) {
+        settings.shared_rates[i] = 0;
+    }
+    settings.read_queue = NULL;
+    settings.write_queue = NULL;
+    for (int i = 0; i < NUM_OP_CLASSES; ++i) {
+        settings.op_limiters[i] = NULL;
+        settings.user_op_limiters[i] = NULL;
+    }
+    settings.rate_config = NULL;
+    settings.read_latency_limiter = NULL;
+    settings.write_latency_limiter = NULL;
     settings.new_uid = -1;
     settings.new_gid = -1;
     settings.create_for_uid = -1;
@@ -2608,7 +4396,30 @@ int main(int argc, char *argv[])
     settings.forward_odirect = 0;
     settings.odirect_alignment = 0;
     settings.direct_io = false;
+    settings.direct_io_patterns = NULL;
+    settings.num_direct_io_patterns = 0;
+    settings.direct_io_min_size = 0;
+    settings.direct_io_flags = 0;
 #endif
+    settings.keep_cache = 0;
+    settings.source_readahead = 0;
+    settings.write_behind = 0;
+    settings.sync_policy = SYNC_PASSTHROUGH;
+    settings.sync_rules = NULL;
+    settings.num_sync_rules = 0;
+    settings.sync_interval_ms = 10;
+    settings.passthrough = 0;
+    settings.multithreaded = 0;
+    settings.serialize_ops = 0;
+    settings.stats = 0;
+    settings.metrics = 0;
+    settings.accounting = 0;
+    settings.accounting_by_pid = 0;
+    settings.trace_fd = -1;
+    settings.trace_max_size = 0;
+    settings.max_write = 0;
+    settings.max_read = 0;
+    settings.max_readahead = 0;
 
     atexit(&atexit_func);
 
@@ -2653,11 +4464,20 @@ int main(int argc, char *argv[])
     }
 
     /* Parse rate limits */
+    if (od.rate_burst) {
+        char *endptr;
+        double burst = strtod(od.rate_burst, &endptr);
+        if (*od.rate_burst == '\0' || *endptr != '\0' || burst < 0 || burst > 60) {
+            fprintf(stderr, "Error: Invalid --rate-burst. Expected 0 to 60 seconds.\n");
+            return 1;
+        }
+        rate_limiter_set_idle_credit(-burst);
+    }
     if (od.read_rate) {
         double rate;
         if (parse_byte_count(od.read_rate, &rate) && rate > 0) {
             settings.read_limiter = malloc(sizeof(RateLimiter));
-            rate_limiter_init(settings.read_limiter, rate, &gettimeofday_clock);
+            rate_limiter_init(settings.read_limiter, rate, &monotonic_clock);
         } else {
             fprintf(stderr, "Error: Invalid --read-rate.\n");
             return 1;
@@ -2667,12 +4487,262 @@ int main(int argc, char *argv[])
         double rate;
         if (parse_byte_count(od.write_rate, &rate) && rate > 0) {
             settings.write_limiter = malloc(sizeof(RateLimiter));
-            rate_limiter_init(settings.write_limiter, rate, &gettimeofday_clock);
+            rate_limiter_init(settings.write_limiter, rate, &monotonic_clock);
         } else {
             fprintf(stderr, "Error: Invalid --write-rate.\n");
             return 1;
         }
     }
+    if (od.read_rate_per_user) {
+        double rate;
+        if (parse_byte_count(od.read_rate_per_user, &rate) && rate > 0) {
+            settings.user_read_limiters = rate_limiter_table_create(rate, &monotonic_clock);
+        } else {
+            fprintf(stderr, "Error: Invalid --read-rate-per-user.\n");
+            return 1;
+        }
+    }
+    if (od.write_rate_per_user) {
+        double rate;
+        if (parse_byte_count(od.write_rate_per_user, &rate) && rate > 0) {
+            settings.user_write_limiters = rate_limiter_table_create(rate, &monotonic_clock);
+        } else {
+            fprintf(stderr, "Error: Invalid --write-rate-per-user.\n");
+            return 1;
+        }
+    }
+    if (od.rate_limit_by) {
+        if (strcmp(od.rate_limit_by, "uid") == 0) {
+            settings.rate_limit_by_gid = 0;
+        } else if (strcmp(od.rate_limit_by, "gid") == 0) {
+            settings.rate_limit_by_gid = 1;
+        } else {
+            fprintf(stderr, "Error: Invalid --rate-limit-by. Expected 'uid' or 'gid'.\n");
+            return 1;
+        }
+    }
+    if (od.shared_read_rate) {
+        if (!parse_byte_count(od.shared_read_rate, &settings.shared_rates[SHARED_BUCKET_READ]) ||
+            settings.shared_rates[SHARED_BUCKET_READ] <= 0) {
+            fprintf(stderr, "Error: Invalid --shared-read-rate.\n");
+            return 1;
+        }
+    }
+    if (od.shared_write_rate) {
+        if (!parse_byte_count(od.shared_write_rate, &settings.shared_rates[SHARED_BUCKET_WRITE]) ||
+            settings.shared_rates[SHARED_BUCKET_WRITE] <= 0) {
+            fprintf(stderr, "Error: Invalid --shared-write-rate.\n");
+            return 1;
+        }
+    }
+    if (od.shared_rate_limit) {
+        if (!od.shared_read_rate && !od.shared_write_rate) {
+            fprintf(stderr, "Error: --shared-rate-limit requires --shared-read-rate or --shared-write-rate.\n");
+            return 1;
+        }
+        if (!shared_limiter_valid_name(od.shared_rate_limit)) {
+            fprintf(stderr, "Error: Invalid --shared-rate-limit. Use up to 20 letters, digits, '-', '_' or '.'.\n");
+            return 1;
+        }
+        settings.shared_limiter = shared_limiter_open(od.shared_rate_limit);
+        if (settings.shared_limiter == NULL) {
+            fprintf(stderr, "Failed to open shared rate limit '%s': %s\n",
+                    od.shared_rate_limit, strerror(errno));
+            return 1;
+        }
+    } else if (od.shared_read_rate || od.shared_write_rate) {
+        fprintf(stderr, "Error: --shared-read-rate and --shared-write-rate require --shared-rate-limit.\n");
+        return 1;
+    }
+
+    if (od.metrics) {
+        if (!metrics_valid_name(od.metrics)) {
+            fprintf(stderr, "Error: Invalid --metrics. Use up to 18 letters, digits, '-', '_' or '.'.\n");
+            return 1;
+        }
+        if (metrics_open(od.metrics) == -1) {
+            if (errno == EADDRINUSE) {
+                const struct metrics_segment *seg = metrics_attach(od.metrics);
+                if (seg) {
+                    fprintf(stderr, "Failed to create metrics '%s': already in use by pid %lld.\n",
+                            od.metrics, (long long)seg->pid);
+                    metrics_detach(seg);
+                } else {
+                    fprintf(stderr, "Failed to create metrics '%s': already in use.\n", od.metrics);
+                }
+            } else {
+                fprintf(stderr, "Failed to create metrics '%s': %s\n", od.metrics, strerror(errno));
+            }
+            return 1;
+        }
+        settings.metrics = 1;
+    }
+
+    if (od.accounting) {
+        if (strcmp(od.accounting, "uid") == 0) {
+            settings.accounting_by_pid = 0;
+        } else if (strcmp(od.accounting, "pid") == 0) {
+            settings.accounting_by_pid = 1;
+        } else {
+            fprintf(stderr, "Error: Invalid --accounting. Expected 'uid' or 'pid'.\n");
+            return 1;
+        }
+        if (accounting_init() == -1) {
+            fprintf(stderr, "Failed to allocate accounting table: %s\n", strerror(errno));
+            return 1;
+        }
+        settings.accounting = 1;
+    }
+
+    if (od.trace_max_size) {
+        double size;
+        if (!od.trace) {
+            fprintf(stderr, "Error: --trace-max-size requires --trace.\n");
+            return 1;
+        }
+        if (!parse_byte_count(od.trace_max_size, &size) || size < 1) {
+            fprintf(stderr, "Error: Invalid --trace-max-size.\n");
+            return 1;
+        }
+        settings.trace_max_size = (uint64_t)size;
+    }
+    if (od.trace) {
+        settings.trace_fd = open(od.trace, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (settings.trace_fd == -1) {
+            fprintf(stderr, "Failed to open trace file '%s': %s\n", od.trace, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (settings.fair_queue) {
+        if (!settings.read_limiter && !settings.write_limiter) {
+            fprintf(stderr, "Error: --fair-queue requires --read-rate or --write-rate.\n");
+            return 1;
+        }
+        if (settings.read_limiter) {
+            settings.read_queue = fair_queue_create(settings.read_limiter);
+        }
+        if (settings.write_limiter) {
+            settings.write_queue = fair_queue_create(settings.write_limiter);
+        }
+        if ((settings.read_limiter && !settings.read_queue) ||
+            (settings.write_limiter && !settings.write_queue)) {
+            fprintf(stderr, "Error: Failed to set up --fair-queue.\n");
+            return 1;
+        }
+    }
+    if (od.fair_queue_weights) {
+        if (!settings.fair_queue) {
+            fprintf(stderr, "Error: --fair-queue-weights requires --fair-queue.\n");
+            return 1;
+        }
+        if (!parse_fair_queue_weights(od.fair_queue_weights)) {
+            fprintf(stderr, "Error: Invalid --fair-queue-weights.\n");
+            return 1;
+        }
+    }
+    if (od.op_rate && !parse_op_rates(od.op_rate, 0)) {
+        fprintf(stderr, "Error: Invalid --op-rate.\n");
+        return 1;
+    }
+    if (od.op_rate_per_user && !parse_op_rates(od.op_rate_per_user, 1)) {
+        fprintf(stderr, "Error: Invalid --op-rate-per-user.\n");
+        return 1;
+    }
+    if (od.latency_target) {
+        char *endptr;
+        double ms = strtod(od.latency_target, &endptr);
+        if (*od.latency_target == '\0' || *endptr != '\0' || ms <= 0) {
+            fprintf(stderr, "Error: Invalid --latency-target. Expected milliseconds.\n");
+            return 1;
+        }
+        settings.read_latency_limiter =
+            adaptive_limiter_create(ms / 1000, latency_target_min_rate, &monotonic_clock);
+        settings.write_latency_limiter =
+            adaptive_limiter_create(ms / 1000, latency_target_min_rate, &monotonic_clock);
+    }
+    if (od.rate_config) {
+        /* fuse_main changes the working directory when daemonizing. */
+        settings.rate_config = realpath(od.rate_config, NULL);
+        if (settings.rate_config == NULL) {
+            fprintf(stderr, "Failed to open rate config %s: %s\n", od.rate_config, strerror(errno));
+            return 1;
+        }
+        if (!load_rate_config(settings.rate_config)) {
+            return 1;
+        }
+    }
+
+    /* Parse request sizes */
+    if (od.max_write && !parse_request_size(od.max_write, &settings.max_write)) {
+        fprintf(stderr, "Error: Invalid --max-write.\n");
+        return 1;
+    }
+    if (od.max_read && !parse_request_size(od.max_read, &settings.max_read)) {
+        fprintf(stderr, "Error: Invalid --max-read.\n");
+        return 1;
+    }
+    if (od.max_readahead && !parse_request_size(od.max_readahead, &settings.max_readahead)) {
+        fprintf(stderr, "Error: Invalid --max-readahead.\n");
+        return 1;
+    }
+
+    if (od.source_readahead) {
+#ifdef HAVE_POSIX_FADVISE
+        if (!parse_request_size(od.source_readahead, &settings.source_readahead)) {
+            fprintf(stderr, "Error: Invalid --source-readahead.\n");
+            return 1;
+        }
+#else
+        fprintf(stderr, "Warning: --source-readahead is not supported on this platform.\n");
+#endif
+    }
+
+    if (od.write_behind && !parse_request_size(od.write_behind, &settings.write_behind)) {
+        fprintf(stderr, "Error: Invalid --write-behind.\n");
+        return 1;
+    }
+
+    /* Parse sync policy */
+    if (od.sync_policy && !parse_sync_policy(od.sync_policy, &settings.sync_policy)) {
+        fprintf(stderr, "Error: Invalid --sync-policy.\n");
+        return 1;
+    }
+    if (od.sync_policy_rules && !parse_sync_rules(od.sync_policy_rules)) {
+        fprintf(stderr, "Error: Invalid --sync-policy-rules.\n");
+        return 1;
+    }
+    if (od.sync_interval) {
+        char *endptr;
+        unsigned long interval = strtoul(od.sync_interval, &endptr, 10);
+        if (*od.sync_interval == '\0' || *endptr != '\0' || interval > 60000) {
+            fprintf(stderr, "Error: Invalid --sync-interval.\n");
+            return 1;
+        }
+        settings.sync_interval_ms = interval;
+    }
+
+    if (settings.passthrough) {
+#ifdef PASSTHROUGH_SUPPORTED
+        if (settings.read_limiter || settings.write_limiter ||
+            settings.user_read_limiters || settings.user_write_limiters ||
+            settings.shared_limiter || settings.read_latency_limiter || settings.direct_io) {
+            fprintf(stderr, "Warning: --passthrough has no effect with rate limits or --direct-io.\n");
+            settings.passthrough = 0;
+        } else if (settings.write_behind || settings.source_readahead) {
+            fprintf(stderr, "Warning: --passthrough has no effect with --write-behind "
+                            "or --source-readahead.\n");
+            settings.passthrough = 0;
+        } else if (settings.stats || settings.metrics || settings.accounting) {
+            fprintf(stderr, "Warning: with --passthrough, reads and writes of regular files "
+                            "are not counted by --stats, --metrics or --accounting.\n");
+        }
+#else
+        fprintf(stderr, "To use --passthrough, bindfs must be compiled "
+                        "on Linux with FUSE 3.16 or newer.\n");
+        return 1;
+#endif
+    }
 
     /* Parse passwd */
     if (od.map_passwd) {
@@ -2783,6 +4853,31 @@ int main(int argc, char *argv[])
 #endif
     }
 
+    /* Parse per-file direct I/O policy */
+#ifdef __linux__
+    if (od.direct_io_paths) {
+        if (!parse_direct_io_paths(od.direct_io_paths)) {
+            fprintf(stderr, "Error: Out of memory parsing --direct-io-paths.\n");
+            return 1;
+        }
+    }
+    if (od.direct_io_min_size) {
+        double size;
+        if (parse_byte_count(od.direct_io_min_size, &size) && size >= 1) {
+            settings.direct_io_min_size = (off_t)size;
+        } else {
+            fprintf(stderr, "Error: Invalid --direct-io-min-size.\n");
+            return 1;
+        }
+    }
+    if (od.direct_io_flags) {
+        if (!parse_direct_io_flags(od.direct_io_flags)) {
+            fprintf(stderr, "Error: Invalid --direct-io-flags.\n");
+            return 1;
+        }
+    }
+#endif
+
     /* Parse user and group for new creates */
     if (od.create_for_user) {
         if (getuid() != 0) {
@@ -2858,9 +4953,17 @@ int main(int argc, char *argv[])
     }
 
 
-    /* Single-threaded mode by default */
+    settings.multithreaded = od.multithreaded;
+
+    /* Single-threaded mode by default. With rate limits, we get the same
+       effect by serializing operations ourselves, so that waiting for the
+       limit doesn't block the whole mount. */
     if (!od.multithreaded) {
-        fuse_opt_add_arg(&args, "-s");
+        if (is_throttling_enabled()) {
+            settings.serialize_ops = 1;
+        } else {
+            fuse_opt_add_arg(&args, "-s");
+        }
     }
 
     /* Add default fuse options */
@@ -2868,6 +4971,12 @@ int main(int argc, char *argv[])
         fuse_opt_add_arg(&args, "-oallow_other");
     }
 
+    if (settings.max_read) {
+        char *tmp = sprintf_new("-omax_read=%zu", settings.max_read);
+        fuse_opt_add_arg(&args, tmp);
+        free(tmp);
+    }
+
     /* We want the kernel to do our access checks for us based on what getattr gives it. */
     fuse_opt_add_arg(&args, "-odefault_permissions");
 
@@ -2945,6 +5054,13 @@ int main(int argc, char *argv[])
         bindfs_oper.removexattr = NULL;
     }
 
+    /* Group commit batches concurrent syncs, and there are none in
+       single-threaded mode. */
+    if (uses_group_commit() && !od.multithreaded) {
+        fprintf(stderr, "To use --sync-policy=group-commit, you must use --multithreaded.\n");
+        return 1;
+    }
+
 #if defined(HAVE_FUSE_29) || defined(HAVE_FUSE_3)
     /* Check that lock forwarding is not enabled in single-threaded mode. */
     if (settings.enable_lock_forwarding && !od.multithreaded) {
@@ -2986,6 +5102,17 @@ int main(int argc, char *argv[])
     }
 #endif
 
+    /* Without write-behind, there's nothing to do on close() */
+    if (!settings.write_behind) {
+        bindfs_oper.flush = NULL;
+    }
+
+    /* The probes are in the wrappers, and cost nothing until attached to. */
+    if (BINDFS_PROBES_ENABLED || settings.serialize_ops || settings.stats || settings.metrics ||
+        settings.accounting || settings.trace_fd != -1) {
+        wrap_operations(&bindfs_oper);
+    }
+
     /* Remove/Ignore some special -o options */
     args = filter_special_opts(&args);
 
@@ -0,0 +1,222 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* bindfs-stat: shows the activity of a bindfs mount started with
+ * --metrics=NAME, in the style of vmstat. */
+
+#include <config.h>
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct sample {
+    double time;
+    uint32_t num_ops;
+    uint64_t op_counts[METRICS_MAX_OPS];
+    uint64_t op_errors[METRICS_MAX_OPS];
+    uint64_t values[NUM_METRICS];
+};
+
+static void print_usage(const char *progname)
+{
+    printf("Usage: %s [-o] NAME [INTERVAL [COUNT]]\n"
+           "\n"
+           "Shows the activity of the bindfs mount started with --metrics=NAME.\n"
+           "The first line is the average since the mount was started. With an\n"
+           "INTERVAL in seconds, prints another line every INTERVAL seconds,\n"
+           "COUNT times or until interrupted.\n"
+           "\n"
+           "  -o    Also show each operation separately.\n"
+           "  -h    Show this help.\n",
+           progname);
+}
+
+static double monotonic_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void take_sample(const struct metrics_segment *seg, struct sample *s)
+{
+    s->time = monotonic_now();
+    s->num_ops = __atomic_load_n(&seg->num_ops, __ATOMIC_ACQUIRE);
+    if (s->num_ops > METRICS_MAX_OPS) {
+        s->num_ops = METRICS_MAX_OPS;
+    }
+    for (uint32_t i = 0; i < s->num_ops; ++i) {
+        s->op_counts[i] = __atomic_load_n(&seg->op_counts[i], __ATOMIC_RELAXED);
+        s->op_errors[i] = __atomic_load_n(&seg->op_errors[i], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < NUM_METRICS; ++i) {
+        s->values[i] = __atomic_load_n(&seg->values[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void print_header(void)
+{
+    printf("%10s %10s %10s %10s %13s %8s\n",
+           "ops/s", "errors/s", "rkB/s", "wkB/s", "throttle_ms/s", "rebuilds");
+}
+
+/* Prints the rates between `prev` and `cur`, which may be all zeroes. */
+static void print_line(const struct metrics_segment *seg, const struct sample *prev,
+                       const struct sample *cur, double elapsed, int per_op)
+{
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    for (uint32_t i = 0; i < cur->num_ops; ++i) {
+        ops += cur->op_counts[i] - (i < prev->num_ops ? prev->op_counts[i] : 0);
+        errors += cur->op_errors[i] - (i < prev->num_ops ? prev->op_errors[i] : 0);
+    }
+    uint64_t values[NUM_METRICS];
+    for (int i = 0; i < NUM_METRICS; ++i) {
+        values[i] = cur->values[i] - prev->values[i];
+    }
+
+    if (per_op) {
+        print_header();
+    }
+    printf("%10.1f %10.1f %10.1f %10.1f %13.1f %8llu\n",
+           ops / elapsed,
+           errors / elapsed,
+           values[METRIC_BYTES_READ] / 1024.0 / elapsed,
+           values[METRIC_BYTES_WRITTEN] / 1024.0 / elapsed,
+           values[METRIC_THROTTLE_NS] / 1e6 / elapsed,
+           (unsigned long long)values[METRIC_USER_CACHE_REBUILDS]);
+
+    if (per_op) {
+        printf("\n%-20s %10s %10s\n", "op", "ops/s", "errors/s");
+        for (uint32_t i = 0; i < cur->num_ops; ++i) {
+            uint64_t count = cur->op_counts[i] - (i < prev->num_ops ? prev->op_counts[i] : 0);
+            uint64_t errs = cur->op_errors[i] - (i < prev->num_ops ? prev->op_errors[i] : 0);
+            if (count > 0) {
+                printf("%-20.*s %10.1f %10.1f\n", METRICS_OP_NAME_LEN, seg->op_names[i],
+                       count / elapsed, errs / elapsed);
+            }
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+static int bindfs_running(const struct metrics_segment *seg)
+{
+    pid_t pid = (pid_t)__atomic_load_n(&seg->pid, __ATOMIC_RELAXED);
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+int main(int argc, char *argv[])
+{
+    int per_op = 0;
+    double interval = 0;
+    long count = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "oh")) != -1) {
+        switch (opt) {
+        case 'o':
+            per_op = 1;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || argc - optind > 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *name = argv[optind];
+    if (optind + 1 < argc) {
+        char *end;
+        interval = strtod(argv[optind + 1], &end);
+        if (*end != '\0' || !(interval > 0)) {
+            fprintf(stderr, "%s: invalid interval: %s\n", argv[0], argv[optind + 1]);
+            return 1;
+        }
+    }
+    if (optind + 2 < argc) {
+        char *end;
+        count = strtol(argv[optind + 2], &end, 10);
+        if (*end != '\0' || count <= 0) {
+            fprintf(stderr, "%s: invalid count: %s\n", argv[0], argv[optind + 2]);
+            return 1;
+        }
+    }
+
+    const struct metrics_segment *seg = metrics_attach(name);
+    if (seg == NULL) {
+        if (errno == ENOENT) {
+            fprintf(stderr, "%s: no bindfs is running with --metrics=%s\n", argv[0], name);
+        } else {
+            fprintf(stderr, "%s: failed to open metrics for %s: %s\n",
+                    argv[0], name, strerror(errno));
+        }
+        return 1;
+    }
+
+    static struct sample samples[2];
+    struct sample *prev = &samples[0];
+    struct sample *cur = &samples[1];
+
+    take_sample(seg, cur);
+    double uptime = difftime(time(NULL), (time_t)seg->start_time);
+    if (uptime < 1) {
+        uptime = 1;
+    }
+    if (!per_op) {
+        print_header();
+    }
+    print_line(seg, prev, cur, uptime, per_op);
+
+    int status = 0;
+    while (interval > 0 && (count < 0 || --count > 0)) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)interval;
+        ts.tv_nsec = (long)((interval - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+
+        if (!bindfs_running(seg)) {
+            fprintf(stderr, "%s: bindfs has exited\n", argv[0]);
+            status = 1;
+            break;
+        }
+
+        struct sample *tmp = prev;
+        prev = cur;
+        cur = tmp;
+        take_sample(seg, cur);
+        print_line(seg, prev, cur, cur->time - prev->time, per_op);
+    }
+
+    metrics_detach(seg);
+    return status;
+}
@@ -0,0 +1,169 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* bindfs-trace: prints a trace file written by bindfs --trace as text. */
+
+#include <config.h>
+
+#include "trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct thread_state {
+    uint32_t tid;
+    uint64_t enter_time_ns;  /* 0 if not in an operation. */
+};
+
+static void print_usage(const char *progname)
+{
+    printf("Usage: %s FILE\n"
+           "\n"
+           "Prints a trace written by bindfs --trace=FILE, sorted by time.\n"
+           "'>' marks the start of an operation and '<' its end, with the\n"
+           "result and how long it took.\n",
+           progname);
+}
+
+static int compare_events(const void *a, const void *b)
+{
+    const struct trace_event *ea = a;
+    const struct trace_event *eb = b;
+    if (ea->time_ns != eb->time_ns) {
+        return ea->time_ns < eb->time_ns ? -1 : 1;
+    }
+    return (ea->type == TRACE_EXIT) - (eb->type == TRACE_EXIT);
+}
+
+static struct thread_state *find_thread(struct thread_state **threads, size_t *count, uint32_t tid)
+{
+    for (size_t i = 0; i < *count; ++i) {
+        if ((*threads)[i].tid == tid) {
+            return &(*threads)[i];
+        }
+    }
+    struct thread_state *grown = realloc(*threads, (*count + 1) * sizeof(struct thread_state));
+    if (grown == NULL) {
+        return NULL;
+    }
+    *threads = grown;
+    grown[*count].tid = tid;
+    grown[*count].enter_time_ns = 0;
+    return &grown[(*count)++];
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        print_usage(argv[0]);
+        return argc == 2 ? 0 : 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+        return 1;
+    }
+
+    struct trace_header header;
+    static char op_names[TRACE_MAX_OPS][TRACE_OP_NAME_LEN];
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION || header.num_ops > TRACE_MAX_OPS ||
+        fread(op_names, TRACE_OP_NAME_LEN, header.num_ops, f) != header.num_ops) {
+        fprintf(stderr, "%s: %s is not a bindfs trace\n", argv[0], argv[1]);
+        fclose(f);
+        return 1;
+    }
+
+    struct trace_event *events = NULL;
+    size_t num_events = 0;
+    size_t capacity = 0;
+    while (1) {
+        if (num_events == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            struct trace_event *grown = realloc(events, capacity * sizeof(struct trace_event));
+            if (grown == NULL) {
+                fprintf(stderr, "%s: out of memory\n", argv[0]);
+                free(events);
+                fclose(f);
+                return 1;
+            }
+            events = grown;
+        }
+        size_t n = fread(&events[num_events], sizeof(struct trace_event),
+                         capacity - num_events, f);
+        num_events += n;
+        if (num_events < capacity) {
+            break;
+        }
+    }
+    fclose(f);
+
+    qsort(events, num_events, sizeof(struct trace_event), compare_events);
+
+    struct thread_state *threads = NULL;
+    size_t num_threads = 0;
+    uint64_t start_ns = num_events > 0 ? events[0].time_ns : 0;
+    for (size_t i = 0; i < num_events; ++i) {
+        struct trace_event *e = &events[i];
+        const char *op = e->op < header.num_ops ? op_names[e->op] : "?";
+        struct thread_state *t = find_thread(&threads, &num_threads, e->tid);
+        printf("%12.6f %8u ", (e->time_ns - start_ns) / 1e9, (unsigned int)e->tid);
+
+        switch (e->type) {
+        case TRACE_ENTER:
+            e->path[TRACE_PATH_LEN - 1] = '\0';
+            printf("> %.*s %s\n", TRACE_OP_NAME_LEN, op, e->path);
+            if (t != NULL) {
+                t->enter_time_ns = e->time_ns;
+            }
+            break;
+        case TRACE_EXIT:
+            printf("< %.*s = %lld", TRACE_OP_NAME_LEN, op, (long long)e->result);
+            if (e->result < 0) {
+                printf(" (%s)", strerror((int)-e->result));
+            }
+            if (t != NULL && t->enter_time_ns != 0) {
+                printf(" %.0fus", (e->time_ns - t->enter_time_ns) / 1e3);
+                t->enter_time_ns = 0;
+            }
+            printf("\n");
+            break;
+        case TRACE_DROPPED:
+            printf("! dropped %lld events\n", (long long)e->result);
+            if (t != NULL) {
+                t->enter_time_ns = 0;
+            }
+            break;
+        case TRACE_TRUNCATED:
+            printf("! trace stopped at its maximum size of %lld bytes\n", (long long)e->result);
+            break;
+        default:
+            printf("? unknown event type %d\n", e->type);
+            break;
+        }
+    }
+
+    free(threads);
+    free(events);
+    return 0;
+}
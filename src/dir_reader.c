@@ -0,0 +1,282 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dir_reader.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+
+/* The same as glibc's readdir() buffer. Large enough for any name. */
+#define DIR_READER_BUFFER_SIZE (32 * 1024)
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct dir_reader {
+    int fd;
+    uint64_t id;       /* Identifies this reader's entries in a thread_buffer. */
+    off_t pos;         /* Offset of the next entry to give out. */
+    off_t fd_pos;      /* Where the fd is, i.e. after the last getdents64. */
+    unsigned short peeked_reclen;
+    off_t peeked_next_offset;
+};
+
+/* Holds entries that a reader got from getdents64 but hasn't given out yet.
+   If the next call for the same reader comes on the same thread, which is
+   always the case in single-threaded mode, it continues from here.
+   Otherwise the entries are read again. */
+struct thread_buffer {
+    uint64_t owner;    /* The `id` of the reader whose entries these are. 0 if none. */
+    off_t owner_pos;   /* The reader's `pos` corresponding to `cur`. */
+    size_t size;
+    size_t cur;
+    char data[DIR_READER_BUFFER_SIZE];
+};
+
+static pthread_key_t thread_buffer_key;
+static pthread_once_t thread_buffer_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t next_id_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t next_id = 1;
+
+static uint64_t new_reader_id(void)
+{
+    pthread_mutex_lock(&next_id_lock);
+    uint64_t id = next_id++;
+    pthread_mutex_unlock(&next_id_lock);
+    return id;
+}
+
+static void create_thread_buffer_key(void)
+{
+    int status = pthread_key_create(&thread_buffer_key, &free);
+    assert(status == 0);
+    (void)status;
+}
+
+static struct thread_buffer *get_thread_buffer(void)
+{
+    pthread_once(&thread_buffer_key_once, &create_thread_buffer_key);
+    struct thread_buffer *tb = pthread_getspecific(thread_buffer_key);
+    if (tb == NULL) {
+        tb = malloc(sizeof(struct thread_buffer));
+        if (tb == NULL) {
+            return NULL;
+        }
+        tb->owner = 0;
+        if (pthread_setspecific(thread_buffer_key, tb) != 0) {
+            free(tb);
+            return NULL;
+        }
+    }
+    return tb;
+}
+
+struct dir_reader *dir_reader_open(int fd)
+{
+    struct dir_reader *dr = malloc(sizeof(struct dir_reader));
+    if (dr == NULL) {
+        return NULL;
+    }
+    dr->fd = fd;
+    dr->pos = 0;
+    dr->fd_pos = 0;
+    dr->peeked_reclen = 0;
+    dr->peeked_next_offset = 0;
+    dr->id = new_reader_id();
+    return dr;
+}
+
+int dir_reader_fd(struct dir_reader *dr)
+{
+    return dr->fd;
+}
+
+off_t dir_reader_tell(struct dir_reader *dr)
+{
+    return dr->pos;
+}
+
+void dir_reader_seek(struct dir_reader *dr, off_t offset)
+{
+    /* Forget buffered entries so that a rewind sees changes to the directory. */
+    dr->id = new_reader_id();
+    dr->pos = offset;
+}
+
+int dir_reader_peek(struct dir_reader *dr, struct dir_reader_entry *entry)
+{
+    struct thread_buffer *tb = get_thread_buffer();
+    if (tb == NULL) {
+        return -ENOMEM;
+    }
+
+    if (tb->owner != dr->id || tb->owner_pos != dr->pos || tb->cur >= tb->size) {
+        tb->owner = 0;
+        if (dr->fd_pos != dr->pos) {
+            if (lseek(dr->fd, dr->pos, SEEK_SET) == (off_t)-1) {
+                return -errno;
+            }
+            dr->fd_pos = dr->pos;
+        }
+
+        long amount = syscall(SYS_getdents64, dr->fd, tb->data, sizeof(tb->data));
+        if (amount < 0) {
+            return -errno;
+        } else if (amount == 0) {
+            return 0;
+        }
+
+        tb->owner = dr->id;
+        tb->owner_pos = dr->pos;
+        tb->size = (size_t)amount;
+        tb->cur = 0;
+
+        /* The fd is left after the last entry we got. */
+        size_t i = 0;
+        struct linux_dirent64 *last = NULL;
+        while (i < tb->size) {
+            last = (struct linux_dirent64 *)&tb->data[i];
+            i += last->d_reclen;
+        }
+        dr->fd_pos = last->d_off;
+    }
+
+    struct linux_dirent64 *de = (struct linux_dirent64 *)&tb->data[tb->cur];
+    entry->name = de->d_name;
+    entry->ino = de->d_ino;
+    entry->type = de->d_type;
+    entry->next_offset = de->d_off;
+
+    dr->peeked_reclen = de->d_reclen;
+    dr->peeked_next_offset = de->d_off;
+    return 1;
+}
+
+void dir_reader_next(struct dir_reader *dr)
+{
+    struct thread_buffer *tb = get_thread_buffer();
+    if (tb != NULL && tb->owner == dr->id && tb->owner_pos == dr->pos) {
+        tb->cur += dr->peeked_reclen;
+        tb->owner_pos = dr->peeked_next_offset;
+    }
+    dr->pos = dr->peeked_next_offset;
+}
+
+void dir_reader_close(struct dir_reader *dr)
+{
+    close(dr->fd);
+    free(dr);
+}
+
+#else  /* Portable version using readdir() */
+
+struct dir_reader {
+    DIR *dp;
+    struct dirent *entry;  /* Read from dp but not yet moved past. */
+    off_t entry_next_offset;
+    off_t pos;
+};
+
+struct dir_reader *dir_reader_open(int fd)
+{
+    struct dir_reader *dr = malloc(sizeof(struct dir_reader));
+    if (dr == NULL) {
+        return NULL;
+    }
+    dr->dp = fdopendir(fd);
+    if (dr->dp == NULL) {
+        free(dr);
+        return NULL;
+    }
+    dr->entry = NULL;
+    dr->entry_next_offset = 0;
+    dr->pos = 0;
+    return dr;
+}
+
+int dir_reader_fd(struct dir_reader *dr)
+{
+    return dirfd(dr->dp);
+}
+
+off_t dir_reader_tell(struct dir_reader *dr)
+{
+    return dr->pos;
+}
+
+void dir_reader_seek(struct dir_reader *dr, off_t offset)
+{
+    if (offset == 0) {
+        rewinddir(dr->dp);
+    } else {
+        seekdir(dr->dp, offset);
+    }
+    dr->entry = NULL;
+    dr->pos = offset;
+}
+
+int dir_reader_peek(struct dir_reader *dr, struct dir_reader_entry *entry)
+{
+    if (dr->entry == NULL) {
+        errno = 0;
+        dr->entry = readdir(dr->dp);
+        if (dr->entry == NULL) {
+            return errno != 0 ? -errno : 0;
+        }
+        dr->entry_next_offset = telldir(dr->dp);
+    }
+
+    entry->name = dr->entry->d_name;
+    entry->ino = dr->entry->d_ino;
+    entry->type = dr->entry->d_type;
+    entry->next_offset = dr->entry_next_offset;
+    return 1;
+}
+
+void dir_reader_next(struct dir_reader *dr)
+{
+    dr->entry = NULL;
+    dr->pos = dr->entry_next_offset;
+}
+
+void dir_reader_close(struct dir_reader *dr)
+{
+    closedir(dr->dp);
+    free(dr);
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_DIR_READER_H
+#define INC_BINDFS_DIR_READER_H
+
+#include <sys/types.h>
+
+/* Reads the entries of an open directory piece by piece, remembering the
+ * position between calls so that a listing can be streamed to the kernel.
+ *
+ * On Linux, entries are read with getdents64 into a large buffer that is
+ * allocated once per thread and reused by all readers. Elsewhere, readdir()
+ * is used. */
+struct dir_reader;
+
+struct dir_reader_entry {
+    const char *name;
+    ino_t ino;
+    unsigned char type;  /* DT_* */
+    off_t next_offset;   /* Position just after this entry. */
+};
+
+/* Takes ownership of `fd`, which must be an open directory.
+   Returns NULL and sets errno on failure, in which case `fd` is not closed. */
+struct dir_reader *dir_reader_open(int fd);
+
+/* The directory's file descriptor, e.g. for fstatat(). */
+int dir_reader_fd(struct dir_reader *dr);
+
+/* The current position. 0 is the start of the directory. */
+off_t dir_reader_tell(struct dir_reader *dr);
+
+/* Moves to `offset`, which must be 0 or a `next_offset` given out earlier. */
+void dir_reader_seek(struct dir_reader *dr, off_t offset);
+
+/* Gets the entry at the current position without moving past it.
+   Returns 1 on success, 0 at the end of the directory and -errno on error.
+   The entry is valid until the next call on `dr` or on the same thread. */
+int dir_reader_peek(struct dir_reader *dr, struct dir_reader_entry *entry);
+
+/* Moves past the entry last returned by dir_reader_peek. */
+void dir_reader_next(struct dir_reader *dr);
+
+/* Closes the directory and frees the reader. */
+void dir_reader_close(struct dir_reader *dr);
+
+#endif
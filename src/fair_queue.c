@@ -0,0 +1,214 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fair_queue.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct flow {
+    unsigned int key;
+    double weight;
+    bool configured;    /* Has a weight from fair_queue_set_weight. */
+    double last_finish; /* Virtual finish time of the flow's last request. */
+    int num_queued;
+    struct flow *next;
+};
+
+struct request {
+    struct flow *flow;
+    double start;   /* Virtual start time */
+    double finish;  /* Virtual finish time */
+    struct request *next;
+};
+
+#define FLOW_BUCKETS 64
+#define MIN_FLOWS_BEFORE_PRUNE 64
+
+struct FairQueue {
+    RateLimiter *limiter;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    double virtual_time;
+    bool dispatching;  /* A request is sleeping off its cost. */
+    struct flow *flows[FLOW_BUCKETS];  /* Hash table by key */
+    size_t num_flows;
+    size_t prune_at;   /* Prune idle flows when there are this many. */
+    struct request *queue;
+};
+
+/* Forgets flows that have no backlog. They would start from the current
+   virtual time anyway. */
+static void prune_flows(FairQueue *fq)
+{
+    for (int i = 0; i < FLOW_BUCKETS; ++i) {
+        struct flow **prev = &fq->flows[i];
+        while (*prev != NULL) {
+            struct flow *f = *prev;
+            if (!f->configured && f->num_queued == 0 && f->last_finish <= fq->virtual_time) {
+                *prev = f->next;
+                free(f);
+                fq->num_flows--;
+                continue;
+            }
+            prev = &f->next;
+        }
+    }
+
+    /* Let the table double before pruning again, so that pruning costs
+       O(1) per new flow. */
+    fq->prune_at = 2 * fq->num_flows;
+    if (fq->prune_at < MIN_FLOWS_BEFORE_PRUNE) {
+        fq->prune_at = MIN_FLOWS_BEFORE_PRUNE;
+    }
+}
+
+/* Returns NULL if out of memory. */
+static struct flow *get_flow(FairQueue *fq, unsigned int key)
+{
+    struct flow **bucket = &fq->flows[key % FLOW_BUCKETS];
+    for (struct flow *f = *bucket; f != NULL; f = f->next) {
+        if (f->key == key) {
+            return f;
+        }
+    }
+
+    if (fq->num_flows >= fq->prune_at) {
+        prune_flows(fq);
+    }
+
+    struct flow *f = calloc(1, sizeof(struct flow));
+    if (f == NULL) {
+        return NULL;
+    }
+    f->key = key;
+    f->weight = 1.0;
+    f->last_finish = fq->virtual_time;
+    f->next = *bucket;
+    *bucket = f;
+    fq->num_flows++;
+    return f;
+}
+
+static struct request *earliest_request(FairQueue *fq)
+{
+    struct request *best = fq->queue;
+    for (struct request *r = fq->queue; r != NULL; r = r->next) {
+        if (r->finish < best->finish) {
+            best = r;
+        }
+    }
+    return best;
+}
+
+static void remove_request(FairQueue *fq, struct request *req)
+{
+    struct request **prev = &fq->queue;
+    while (*prev != req) {
+        prev = &(*prev)->next;
+    }
+    *prev = req->next;
+}
+
+FairQueue *fair_queue_create(RateLimiter *limiter)
+{
+    FairQueue *fq = calloc(1, sizeof(FairQueue));
+    if (fq == NULL) {
+        return NULL;
+    }
+    fq->limiter = limiter;
+    fq->prune_at = MIN_FLOWS_BEFORE_PRUNE;
+    pthread_mutex_init(&fq->mutex, NULL);
+    pthread_cond_init(&fq->cond, NULL);
+    return fq;
+}
+
+int fair_queue_set_weight(FairQueue *fq, unsigned int key, double weight)
+{
+    pthread_mutex_lock(&fq->mutex);
+    struct flow *f = get_flow(fq, key);
+    if (f != NULL) {
+        f->weight = weight;
+        f->configured = true;
+    }
+    pthread_mutex_unlock(&fq->mutex);
+    return f != NULL ? 0 : ENOMEM;
+}
+
+void fair_queue_wait(FairQueue *fq, unsigned int key, size_t size)
+{
+    struct request req;
+
+    pthread_mutex_lock(&fq->mutex);
+
+    req.flow = get_flow(fq, key);
+    if (req.flow == NULL) {
+        /* Skip the queue rather than not limit at all. */
+        pthread_mutex_unlock(&fq->mutex);
+        rate_limiter_wait(fq->limiter, size);
+        return;
+    }
+    req.start = req.flow->last_finish;
+    if (req.start < fq->virtual_time) {
+        req.start = fq->virtual_time;
+    }
+    req.finish = req.start + size / req.flow->weight;
+    req.flow->last_finish = req.finish;
+    req.flow->num_queued++;
+    req.next = fq->queue;
+    fq->queue = &req;
+
+    /* Requests are let through one at a time. The earliest one pays the
+       limiter for its own size and leaves the queue, and the rest wait
+       while it sleeps off the cost. */
+    while (fq->dispatching || earliest_request(fq) != &req) {
+        pthread_cond_wait(&fq->cond, &fq->mutex);
+    }
+    double time_to_sleep = rate_limiter_wait_nosleep(fq->limiter, size);
+    remove_request(fq, &req);
+    req.flow->num_queued--;
+    if (req.start > fq->virtual_time) {
+        fq->virtual_time = req.start;
+    }
+
+    if (time_to_sleep > 0) {
+        fq->dispatching = true;
+        pthread_mutex_unlock(&fq->mutex);
+        rate_limiter_sleep(time_to_sleep);
+        pthread_mutex_lock(&fq->mutex);
+        fq->dispatching = false;
+    }
+    pthread_cond_broadcast(&fq->cond);
+    pthread_mutex_unlock(&fq->mutex);
+}
+
+void fair_queue_destroy(FairQueue *fq)
+{
+    for (int i = 0; i < FLOW_BUCKETS; ++i) {
+        while (fq->flows[i] != NULL) {
+            struct flow *next = fq->flows[i]->next;
+            free(fq->flows[i]);
+            fq->flows[i] = next;
+        }
+    }
+    pthread_cond_destroy(&fq->cond);
+    pthread_mutex_destroy(&fq->mutex);
+    free(fq);
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_FAIR_QUEUE_H
+#define INC_BINDFS_FAIR_QUEUE_H
+
+#include "rate_limiter.h"
+
+/* Shares a rate limiter between flows (e.g. uids) by weighted fair queuing.
+ *
+ * Waiting requests are queued instead of each sleeping on the limiter on
+ * its own. Each request gets a virtual finish time of
+ * max(now, end of its flow's previous request) + size / weight, in virtual
+ * time. The request with the earliest finish time pays the limiter for
+ * its size and is let through after sleeping off the cost, while the
+ * others keep waiting. A flow with many threads thus gets no more than
+ * its share while others are waiting. */
+typedef struct FairQueue FairQueue;
+
+/* The limiter must outlive the queue. Returns NULL if out of memory. */
+FairQueue *fair_queue_create(RateLimiter *limiter);
+/* Sets the weight of a flow. The default weight is 1.
+   Returns 0 or an error number. */
+int fair_queue_set_weight(FairQueue *fq, unsigned int key, double weight);
+/* Blocks until it's `key`'s turn and the limiter clears `size` units. */
+void fair_queue_wait(FairQueue *fq, unsigned int key, size_t size);
+/* Destroys the queue. No wait calls may be active. */
+void fair_queue_destroy(FairQueue *fq);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include "group_commit.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+struct sync_request {
+    int fd;
+    dev_t dev;
+    int result;
+    bool done;
+    struct sync_request *next;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t committer_cond = PTHREAD_COND_INITIALIZER;  /* Requests arrived or stopping */
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;       /* A batch was committed */
+static struct sync_request *pending = NULL;
+static pthread_t committer_thread;
+static bool running = false;
+static bool stopping = false;
+static unsigned int interval_ms;
+
+/* glibc only declares syncfs() with _GNU_SOURCE. */
+static int sync_filesystem(int fd)
+{
+#ifdef __NR_syncfs
+    if (syscall(__NR_syncfs, fd) == -1) {
+        return -errno;
+    }
+    return 0;
+#else
+    (void)fd;
+    sync();
+    return 0;
+#endif
+}
+
+static int sync_file(int fd)
+{
+    if (fsync(fd) == -1) {
+        return -errno;
+    }
+    return 0;
+}
+
+static void commit(struct sync_request *batch)
+{
+    for (struct sync_request *r = batch; r != NULL; r = r->next) {
+        r->result = 1;  /* Not yet synced */
+    }
+
+    /* Sync each filesystem once, and give its result to all its requests.
+       A lone request only needs its own file synced. */
+    for (struct sync_request *r = batch; r != NULL; r = r->next) {
+        if (r->result != 1) {
+            continue;
+        }
+        bool alone = true;
+        for (struct sync_request *other = r->next; other != NULL; other = other->next) {
+            if (other->result == 1 && other->dev == r->dev) {
+                alone = false;
+                break;
+            }
+        }
+        int res = alone ? sync_file(r->fd) : sync_filesystem(r->fd);
+        for (struct sync_request *other = r; other != NULL; other = other->next) {
+            if (other->result == 1 && other->dev == r->dev) {
+                other->result = res;
+            }
+        }
+    }
+}
+
+static void *committer_main(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (pending == NULL && !stopping) {
+            pthread_cond_wait(&committer_cond, &mutex);
+        }
+        if (pending == NULL && stopping) {
+            break;
+        }
+
+        /* Give other requests a moment to join the batch. */
+        if (!stopping) {
+            pthread_mutex_unlock(&mutex);
+            struct timespec ts;
+            ts.tv_sec = interval_ms / 1000;
+            ts.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+            nanosleep(&ts, NULL);
+            pthread_mutex_lock(&mutex);
+        }
+
+        struct sync_request *batch = pending;
+        pending = NULL;
+        pthread_mutex_unlock(&mutex);
+
+        commit(batch);
+
+        pthread_mutex_lock(&mutex);
+        for (struct sync_request *r = batch; r != NULL; r = r->next) {
+            r->done = true;
+        }
+        pthread_cond_broadcast(&done_cond);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return NULL;
+}
+
+int group_commit_start(unsigned int interval)
+{
+    pthread_mutex_lock(&mutex);
+    interval_ms = interval;
+    stopping = false;
+    int res = pthread_create(&committer_thread, NULL, &committer_main, NULL);
+    running = (res == 0);
+    pthread_mutex_unlock(&mutex);
+    return res;
+}
+
+void group_commit_stop(void)
+{
+    pthread_mutex_lock(&mutex);
+    bool was_running = running;
+    running = false;
+    stopping = true;
+    pthread_cond_signal(&committer_cond);
+    pthread_mutex_unlock(&mutex);
+
+    if (was_running) {
+        pthread_join(committer_thread, NULL);
+    }
+}
+
+int group_commit_sync(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return -errno;
+    }
+
+    struct sync_request request;
+    request.fd = fd;
+    request.dev = st.st_dev;
+    request.result = 0;
+    request.done = false;
+
+    pthread_mutex_lock(&mutex);
+    if (!running) {
+        pthread_mutex_unlock(&mutex);
+        return sync_file(fd);
+    }
+    request.next = pending;
+    pending = &request;
+    pthread_cond_signal(&committer_cond);
+    while (!request.done) {
+        pthread_cond_wait(&done_cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return request.result;
+}
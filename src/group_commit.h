@@ -0,0 +1,41 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_GROUP_COMMIT_H
+#define INC_BINDFS_GROUP_COMMIT_H
+
+/* Batches fsync requests from many files into one syncfs() per filesystem.
+ *
+ * A background thread waits until a request arrives, collects more
+ * requests for a short interval, and then syncs each filesystem that the
+ * collected files are on, once. Where syncfs() isn't available, sync()
+ * is used instead. A file that is alone on its filesystem in a batch is
+ * synced with fsync(). */
+
+/* Starts the committer thread. Returns 0 or an error number. */
+int group_commit_start(unsigned int interval_ms);
+
+/* Commits pending requests and stops the committer thread. */
+void group_commit_stop(void);
+
+/* Blocks until the filesystem of `fd` has been synced by a batch that
+ * started after this call. Returns 0 or -errno. */
+int group_commit_sync(int fd);
+
+#endif
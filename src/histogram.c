@@ -0,0 +1,67 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "histogram.h"
+#include <stdint.h>
+
+int histogram_bucket(double seconds)
+{
+    const int sub_buckets = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+    uint64_t us = seconds > 0 ? (uint64_t)(seconds * 1000000.0) : 0;
+    if (us < (uint64_t)sub_buckets) {
+        return (int)us;
+    }
+    int msb = 63 - __builtin_clzll(us);
+    int sub = (int)(us >> (msb - HISTOGRAM_SUB_BUCKET_BITS)) & (sub_buckets - 1);
+    int bucket = ((msb - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS) + sub;
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+double histogram_bucket_upper_bound(int bucket)
+{
+    const int sub_buckets = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+    if (bucket < sub_buckets) {
+        return (bucket + 1) / 1000000.0;
+    }
+    int shift = (bucket >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    uint64_t lower = (uint64_t)((bucket & (sub_buckets - 1)) | sub_buckets) << shift;
+    uint64_t width = (uint64_t)1 << shift;
+    return (double)(lower + width) / 1000000.0;
+}
+
+double histogram_percentile(const unsigned long long *counts, unsigned long long total,
+                            double fraction)
+{
+    if (total == 0) {
+        return 0;
+    }
+    double exact_rank = total * fraction;
+    unsigned long long rank = (unsigned long long)exact_rank;
+    if (rank < exact_rank || rank < 1) {
+        ++rank;
+    }
+    unsigned long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return histogram_bucket_upper_bound(i);
+        }
+    }
+    return histogram_bucket_upper_bound(HISTOGRAM_BUCKETS - 1);
+}
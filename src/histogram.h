@@ -0,0 +1,41 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_HISTOGRAM_H
+#define INC_BINDFS_HISTOGRAM_H
+
+/* Latency histogram buckets with a relative error of at most 25%.
+ *
+ * Latencies are counted in microseconds. Below 4 µs each value has its own
+ * bucket, and above that each power of two is split into 4 buckets.
+ * Latencies of over about half an hour all go into the last bucket. */
+
+#define HISTOGRAM_SUB_BUCKET_BITS 2
+#define HISTOGRAM_BUCKETS (32 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/* The bucket of a latency in seconds. */
+int histogram_bucket(double seconds);
+/* The largest latency in seconds that falls into `bucket`. */
+double histogram_bucket_upper_bound(int bucket);
+/* The upper bound of the bucket where `fraction` of the `total` counts
+   in `counts` are reached, or 0 if `total` is 0. */
+double histogram_percentile(const unsigned long long *counts, unsigned long long total,
+                            double fraction);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define METRICS_MAGIC 0x6266736du  /* "bfsm" */
+#define METRICS_VERSION 1
+#define MAX_NAME_LEN 18  /* macOS limits shm names to 31 characters. */
+
+static struct metrics_segment *segment = NULL;
+static char segment_name[MAX_NAME_LEN + 1];
+
+static void segment_path(const char *name, char *buf, size_t buf_size)
+{
+    snprintf(buf, buf_size, "/bindfs-stat-%s", name);
+}
+
+int metrics_valid_name(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0 || len > MAX_NAME_LEN) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Whether the existing segment for `name` belongs to a running process.
+   A segment that can't be read is assumed to be in use. One that isn't
+   fully set up may be being created right now, so it's given a second to
+   be finished before it's assumed to be left over from a crash. */
+static int segment_in_use(const char *name)
+{
+    const struct metrics_segment *seg = NULL;
+    for (int i = 0; i < 100; ++i) {
+        seg = metrics_attach(name);
+        if (seg != NULL || errno != EPROTO) {
+            break;
+        }
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    if (seg == NULL) {
+        return errno != ENOENT && errno != EPROTO;
+    }
+    pid_t pid = (pid_t)__atomic_load_n(&seg->pid, __ATOMIC_RELAXED);
+    metrics_detach(seg);
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+int metrics_open(const char *name)
+{
+    char path[64];
+
+    if (!metrics_valid_name(name)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (segment) {
+        errno = EBUSY;
+        return -1;
+    }
+    segment_path(name, path, sizeof(path));
+
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1 && errno == EEXIST) {
+        if (segment_in_use(name)) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        /* Left behind by a bindfs that crashed. Readers still attached
+           to it stop seeing updates. */
+        shm_unlink(path);
+        fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd == -1) {
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(struct metrics_segment)) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        shm_unlink(path);
+        errno = saved_errno;
+        return -1;
+    }
+
+    struct metrics_segment *seg = mmap(NULL, sizeof(struct metrics_segment),
+                                       PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int saved_errno = errno;
+    close(fd);
+    if (seg == MAP_FAILED) {
+        shm_unlink(path);
+        errno = saved_errno;
+        return -1;
+    }
+
+    seg->version = METRICS_VERSION;
+    seg->pid = getpid();
+    seg->start_time = time(NULL);
+    __atomic_store_n(&seg->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+
+    snprintf(segment_name, sizeof(segment_name), "%s", name);
+    segment = seg;
+    return 0;
+}
+
+void metrics_set_pid(int64_t pid)
+{
+    if (segment) {
+        __atomic_store_n(&segment->pid, pid, __ATOMIC_RELAXED);
+    }
+}
+
+int metrics_register_op(const char *name)
+{
+    if (!segment || segment->num_ops >= METRICS_MAX_OPS) {
+        return -1;
+    }
+    uint32_t op = segment->num_ops;
+    snprintf(segment->op_names[op], METRICS_OP_NAME_LEN, "%s", name);
+    __atomic_store_n(&segment->num_ops, op + 1, __ATOMIC_RELEASE);
+    return (int)op;
+}
+
+void metrics_count_op(int op, int failed)
+{
+    if (!segment || op < 0) {
+        return;
+    }
+    __atomic_fetch_add(&segment->op_counts[op], 1, __ATOMIC_RELAXED);
+    if (failed) {
+        __atomic_fetch_add(&segment->op_errors[op], 1, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_add(enum Metric metric, uint64_t amount)
+{
+    if (segment) {
+        __atomic_fetch_add(&segment->values[metric], amount, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_close(void)
+{
+    if (segment) {
+        char path[64];
+        segment_path(segment_name, path, sizeof(path));
+        munmap(segment, sizeof(struct metrics_segment));
+        segment = NULL;
+        shm_unlink(path);
+    }
+}
+
+const struct metrics_segment *metrics_attach(const char *name)
+{
+    char path[64];
+
+    if (!metrics_valid_name(name)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    segment_path(name, path, sizeof(path));
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(struct metrics_segment)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    struct metrics_segment *seg = mmap(NULL, sizeof(struct metrics_segment),
+                                       PROT_READ, MAP_SHARED, fd, 0);
+    int saved_errno = errno;
+    close(fd);
+    if (seg == MAP_FAILED) {
+        errno = saved_errno;
+        return NULL;
+    }
+
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC ||
+        seg->version != METRICS_VERSION) {
+        munmap(seg, sizeof(struct metrics_segment));
+        errno = EPROTO;
+        return NULL;
+    }
+    return seg;
+}
+
+void metrics_detach(const struct metrics_segment *seg)
+{
+    munmap((void *)seg, sizeof(struct metrics_segment));
+}
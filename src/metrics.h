@@ -0,0 +1,81 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_METRICS_H
+#define INC_BINDFS_METRICS_H
+
+#include <stdint.h>
+
+/* Live counters in a named shared memory segment (shm_open), for
+ * bindfs-stat to sample without going through the mount.
+ *
+ * The counters are updated with relaxed atomic adds and only ever grow,
+ * so a reader computes rates from the difference between two samples.
+ * The segment is removed when bindfs exits. */
+
+#define METRICS_MAX_OPS 64
+#define METRICS_OP_NAME_LEN 24
+
+enum Metric {
+    METRIC_BYTES_READ,
+    METRIC_BYTES_WRITTEN,
+    METRIC_THROTTLE_NS,  /* Time spent waiting for rate limits, summed over threads. */
+    METRIC_USER_CACHE_REBUILDS,
+    NUM_METRICS
+};
+
+struct metrics_segment {
+    uint32_t magic;  /* Set last by bindfs. */
+    uint32_t version;
+    int64_t pid;
+    int64_t start_time;  /* Unix time. */
+    uint32_t num_ops;
+    uint32_t reserved;
+    char op_names[METRICS_MAX_OPS][METRICS_OP_NAME_LEN];
+    uint64_t op_counts[METRICS_MAX_OPS];
+    uint64_t op_errors[METRICS_MAX_OPS];
+    uint64_t values[NUM_METRICS];
+};
+
+/* Whether `name` is acceptable as a segment name. */
+int metrics_valid_name(const char *name);
+
+/* Creates the segment for `name` and starts publishing counters to it.
+ * A segment left behind by a process that no longer exists is replaced,
+ * but if its process is still running, this fails with EADDRINUSE.
+ * Only one segment can be open at a time.
+ * Returns -1 and sets errno on error. */
+int metrics_open(const char *name);
+/* Records the pid of the process updating the segment, e.g. after
+ * daemonizing. */
+void metrics_set_pid(int64_t pid);
+/* Returns an id for `metrics_count_op`, or -1 if there is no room. */
+int metrics_register_op(const char *name);
+/* These do nothing if no segment is open or `op` is -1. */
+void metrics_count_op(int op, int failed);
+void metrics_add(enum Metric metric, uint64_t amount);
+/* Stops publishing and removes the segment. */
+void metrics_close(void);
+
+/* Maps the segment for `name` read-only, for bindfs-stat.
+ * Returns NULL and sets errno on error. */
+const struct metrics_segment *metrics_attach(const char *name);
+void metrics_detach(const struct metrics_segment *seg);
+
+#endif
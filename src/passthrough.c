@@ -0,0 +1,67 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "passthrough.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#ifdef PASSTHROUGH_SUPPORTED
+
+#include <linux/fuse.h>
+
+/* The ioctls are a stable kernel ABI, but may be missing from older headers. */
+#ifndef FUSE_DEV_IOC_BACKING_OPEN
+struct fuse_backing_map {
+    int32_t fd;
+    uint32_t flags;
+    uint64_t padding;
+};
+#ifndef FUSE_DEV_IOC_MAGIC
+#define FUSE_DEV_IOC_MAGIC 229
+#endif
+#define FUSE_DEV_IOC_BACKING_OPEN _IOW(FUSE_DEV_IOC_MAGIC, 1, struct fuse_backing_map)
+#define FUSE_DEV_IOC_BACKING_CLOSE _IOW(FUSE_DEV_IOC_MAGIC, 2, uint32_t)
+#endif
+
+int passthrough_open(int dev_fd, int fd)
+{
+    struct fuse_backing_map map;
+    memset(&map, 0, sizeof(map));
+    map.fd = fd;
+
+    int res = ioctl(dev_fd, FUSE_DEV_IOC_BACKING_OPEN, &map);
+    if (res == -1) {
+        return -errno;
+    }
+    if (res == 0) {  /* Not a valid backing id. */
+        return -EIO;
+    }
+    return res;
+}
+
+void passthrough_close(int dev_fd, int backing_id)
+{
+    uint32_t id = (uint32_t)backing_id;
+    ioctl(dev_fd, FUSE_DEV_IOC_BACKING_CLOSE, &id);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_PASSTHROUGH_H
+#define INC_BINDFS_PASSTHROUGH_H
+
+#include <config.h>
+
+/* Kernel FUSE passthrough (Linux 6.9+) lets reads, writes and mmap of an
+ * open file go straight to a backing file registered by the daemon. */
+#if defined(__linux__) && HAVE_DECL_FUSE_CAP_PASSTHROUGH && defined(HAVE_STRUCT_FUSE_FILE_INFO_BACKING_ID)
+#define PASSTHROUGH_SUPPORTED 1
+
+/* Registers `fd` as a backing file on the FUSE device `dev_fd`.
+ * Returns a positive backing id, or -errno on failure.
+ * Requires CAP_SYS_ADMIN. */
+int passthrough_open(int dev_fd, int fd);
+
+/* Releases a backing id returned by passthrough_open. */
+void passthrough_close(int dev_fd, int backing_id);
+
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_PROBES_H
+#define INC_BINDFS_PROBES_H
+
+#include <config.h>
+
+/* USDT probes for bpftrace, SystemTap and similar tools, in the provider
+ * "bindfs". With <sys/sdt.h>, a probe is a single nop plus a note in the
+ * binary, and its arguments are only read by an attached tracer. Without
+ * it, probes compile to nothing.
+ *
+ * op__entry(name, path), op__exit(name, result)
+ *     Each filesystem operation. `result` is a negative errno on error.
+ * source__entry(call), source__exit(call, result)
+ *     Calls to the source filesystem, such as "pread" or "lstat".
+ * throttle__sleep(ns), throttle__wake()
+ *     Waiting for a rate limit. `ns` is the planned sleep, or 0 for a
+ *     --fair-queue wait of unknown length.
+ * user__cache__rebuild__start(), user__cache__rebuild__done()
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define BINDFS_PROBES_ENABLED 1
+#define BINDFS_PROBE0(name) DTRACE_PROBE(bindfs, name)
+#define BINDFS_PROBE1(name, a) DTRACE_PROBE1(bindfs, name, a)
+#define BINDFS_PROBE2(name, a, b) DTRACE_PROBE2(bindfs, name, a, b)
+#else
+#define BINDFS_PROBES_ENABLED 0
+#define BINDFS_PROBE0(name) do { } while (0)
+#define BINDFS_PROBE1(name, a) do { } while (0)
+#define BINDFS_PROBE2(name, a, b) do { } while (0)
+#endif
+
+#endif
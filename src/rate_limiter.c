@@ -17,17 +17,29 @@
     along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#define _XOPEN_SOURCE 700  /* for gettimeofday() on freebsd, and for nanosleep() */
+#define _XOPEN_SOURCE 700  /* for gettimeofday() on freebsd, and for nanosleep() and clock_gettime() */
 
 #include "rate_limiter.h"
-#include <assert.h>
 #include <errno.h>
-#include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
 
 const double rate_limiter_idle_credit = -0.2;
 
+static double idle_credit = -0.2;
+
+double rate_limiter_get_idle_credit(void)
+{
+    double result;
+    __atomic_load(&idle_credit, &result, __ATOMIC_RELAXED);
+    return result;
+}
+
+void rate_limiter_set_idle_credit(double credit)
+{
+    __atomic_store(&idle_credit, &credit, __ATOMIC_RELAXED);
+}
+
 double gettimeofday_clock(void)
 {
     struct timeval tv;
@@ -35,7 +47,18 @@ double gettimeofday_clock(void)
     return tv.tv_sec + tv.tv_usec * 0.000001;
 }
 
-static void sleep_seconds(double s)
+double monotonic_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return ts.tv_sec + ts.tv_nsec * 0.000000001;
+    }
+#endif
+    return gettimeofday_clock();
+}
+
+void rate_limiter_sleep(double s)
 {
     struct timespec ts;
     ts.tv_sec = (time_t)s;
@@ -54,55 +77,63 @@ void rate_limiter_init(RateLimiter *limiter, double rate, double (*clock)(void))
 {
     limiter->rate = rate;
     limiter->clock = clock;
-    limiter->last_modified = limiter->clock();
-    limiter->accumulated_sleep_time = rate_limiter_idle_credit;
-
-    pthread_mutexattr_t attr;
-    int status = pthread_mutexattr_init(&attr);
-    assert(status == 0);
-    status = pthread_mutex_init(&limiter->mutex, &attr);
-    assert(status == 0);
-    status = pthread_mutexattr_destroy(&attr);
-    assert(status == 0);
+    limiter->epoch = limiter->clock();
+    limiter->theoretical_arrival_time = rate_limiter_get_idle_credit();
 }
 
 void rate_limiter_wait(RateLimiter* limiter, size_t size)
 {
     double time_to_sleep = rate_limiter_wait_nosleep(limiter, size);
-    sleep_seconds(time_to_sleep);
+    rate_limiter_sleep(time_to_sleep);
 }
 
 double rate_limiter_wait_nosleep(RateLimiter* limiter, size_t size)
 {
-    int status = pthread_mutex_lock(&limiter->mutex);
-    assert(status == 0);
-
-    double time_to_add = size / limiter->rate;
-
-    double now = limiter->clock();
-    double elapsed = now - limiter->last_modified;
-    if (elapsed < 0) {
-        elapsed = 0;
-    }
+    double now = limiter->clock() - limiter->epoch;
+    return rate_limiter_update_tat(&limiter->theoretical_arrival_time, now,
+                                   size / rate_limiter_get_rate(limiter));
+}
 
-    double time_to_sleep = limiter->accumulated_sleep_time;
-    time_to_sleep -= elapsed;
-    if (time_to_sleep < rate_limiter_idle_credit) {
-        time_to_sleep = rate_limiter_idle_credit;
-    }
-    time_to_sleep += time_to_add;
-    limiter->accumulated_sleep_time = time_to_sleep;
+double rate_limiter_get_rate(RateLimiter* limiter)
+{
+    double rate;
+    __atomic_load(&limiter->rate, &rate, __ATOMIC_RELAXED);
+    return rate;
+}
 
-    limiter->last_modified = now;
+void rate_limiter_set_rate(RateLimiter* limiter, double rate)
+{
+    __atomic_store(&limiter->rate, &rate, __ATOMIC_RELAXED);
+}
 
-    status = pthread_mutex_unlock(&limiter->mutex);
-    assert(status == 0);
+double rate_limiter_update_tat(double *tat, double now, double time_to_add)
+{
+    double credit = rate_limiter_get_idle_credit();
+    double old_tat;
+    double new_tat;
+    __atomic_load(tat, &old_tat, __ATOMIC_RELAXED);
+    do {
+        /* An idle limiter has paid off its debt and has at most the idle
+           credit to give. */
+        new_tat = old_tat;
+        if (new_tat < now + credit) {
+            new_tat = now + credit;
+        }
+        new_tat += time_to_add;
+    } while (!__atomic_compare_exchange(tat, &old_tat, &new_tat,
+                                        1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return new_tat - now;
+}
 
-    return time_to_sleep;
+int rate_limiter_idle(RateLimiter* limiter)
+{
+    double tat;
+    __atomic_load(&limiter->theoretical_arrival_time, &tat, __ATOMIC_RELAXED);
+    return tat <= limiter->clock() - limiter->epoch + rate_limiter_get_idle_credit();
 }
 
 void rate_limiter_destroy(RateLimiter *limiter)
 {
-    int status = pthread_mutex_destroy(&limiter->mutex);
-    assert(status == 0);
+    (void)limiter;
 }
@@ -21,22 +21,31 @@
 #define INC_BINDFS_RATE_LIMITER_H
 
 #include <string.h>
-#include <pthread.h>
 
 /* When we are idle, we allow some time to be "credited" to the next writer.
  * Otherwise, the short pause between requests would "go to waste", lowering
- * the throughput when there is only one requester. */
+ * the throughput when there is only one requester. This is the default. */
 extern const double rate_limiter_idle_credit;
 
+/* The idle credit (a negative number of seconds) of all limiters.
+ * May be changed at any time. */
+double rate_limiter_get_idle_credit(void);
+void rate_limiter_set_idle_credit(double credit);
+
+/* A token bucket kept as the "theoretical arrival time" of GCRA: the time
+ * at which all permits handed out so far will have been paid for.
+ * It is updated with compare-and-swap, so waiting takes no locks. */
 typedef struct RateLimiter {
     double rate;  /* bytes / second */
     double (*clock)(void);
-    double last_modified;
-    double accumulated_sleep_time;
-    pthread_mutex_t mutex;
+    double epoch;  /* Times are kept relative to this for precision. */
+    double theoretical_arrival_time;
 } RateLimiter;
 
 double gettimeofday_clock(void);
+/* Seconds on a clock that doesn't jump when the system time is set.
+ * Falls back to gettimeofday_clock where there is no such clock. */
+double monotonic_clock(void);
 
 /* 0 on success, error number on error. */
 void rate_limiter_init(RateLimiter* limiter, double rate, double (*clock)(void));
@@ -45,6 +54,18 @@ void rate_limiter_wait(RateLimiter* limiter, size_t size);
 /* Updates the rate limiter like `rate_limiter_wait` but does not actually
  * sleep. Returns the time that the caller is expected to sleep. */
 double rate_limiter_wait_nosleep(RateLimiter* limiter, size_t size);
+/* The rate may be changed while the limiter is in use. */
+double rate_limiter_get_rate(RateLimiter* limiter);
+void rate_limiter_set_rate(RateLimiter* limiter, double rate);
+/* The lock-free update behind `rate_limiter_wait_nosleep`, for limiters
+ * whose theoretical arrival time is kept elsewhere, e.g. in shared memory.
+ * `tat` and `now` must be on the same clock. Returns the time to sleep. */
+double rate_limiter_update_tat(double *tat, double now, double time_to_add);
+/* Whether the limiter has been idle long enough to be back in its
+ * initial state. */
+int rate_limiter_idle(RateLimiter* limiter);
+/* Sleeps for the time returned by `rate_limiter_wait_nosleep`. */
+void rate_limiter_sleep(double seconds);
 /* Destroys the rate limiter. No wait_for_permit calls may be active. */
 void rate_limiter_destroy(RateLimiter* limiter);
 
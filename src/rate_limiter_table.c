@@ -0,0 +1,157 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rate_limiter_table.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define NUM_BUCKETS 256
+
+/* How often, in seconds, to look for idle limiters when adding a key. */
+static const double reclaim_interval = 1.0;
+
+struct entry {
+    unsigned int key;
+    RateLimiter limiter;
+    struct entry *next;
+};
+
+struct RateLimiterTable {
+    double rate;
+    double (*clock)(void);
+    /* Taken for reading to use a limiter and for writing to add or remove one. */
+    pthread_rwlock_t lock;
+    struct entry *buckets[NUM_BUCKETS];
+    size_t size;
+    double last_reclaim;
+};
+
+static struct entry *find(RateLimiterTable *table, unsigned int key)
+{
+    struct entry *e = table->buckets[key % NUM_BUCKETS];
+    while (e != NULL && e->key != key) {
+        e = e->next;
+    }
+    return e;
+}
+
+/* Must be called with the write lock held. */
+static void reclaim_idle(RateLimiterTable *table)
+{
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        struct entry **prev = &table->buckets[i];
+        while (*prev != NULL) {
+            struct entry *e = *prev;
+            if (rate_limiter_idle(&e->limiter)) {
+                *prev = e->next;
+                rate_limiter_destroy(&e->limiter);
+                free(e);
+                --table->size;
+            } else {
+                prev = &e->next;
+            }
+        }
+    }
+}
+
+RateLimiterTable *rate_limiter_table_create(double rate, double (*clock)(void))
+{
+    RateLimiterTable *table = calloc(1, sizeof(RateLimiterTable));
+    table->rate = rate;
+    table->clock = clock;
+    int status = pthread_rwlock_init(&table->lock, NULL);
+    assert(status == 0);
+    table->last_reclaim = clock();
+    return table;
+}
+
+void rate_limiter_table_wait(RateLimiterTable *table, unsigned int key, size_t size)
+{
+    rate_limiter_sleep(rate_limiter_table_wait_nosleep(table, key, size));
+}
+
+double rate_limiter_table_wait_nosleep(RateLimiterTable *table, unsigned int key, size_t size)
+{
+    double result;
+
+    pthread_rwlock_rdlock(&table->lock);
+    struct entry *e = find(table, key);
+    if (e != NULL) {
+        result = rate_limiter_wait_nosleep(&e->limiter, size);
+        pthread_rwlock_unlock(&table->lock);
+        return result;
+    }
+    pthread_rwlock_unlock(&table->lock);
+
+    pthread_rwlock_wrlock(&table->lock);
+    double now = table->clock();
+    if (now - table->last_reclaim >= reclaim_interval) {
+        reclaim_idle(table);
+        table->last_reclaim = now;
+    }
+    e = find(table, key);  /* Another thread may have added it. */
+    if (e == NULL) {
+        e = malloc(sizeof(struct entry));
+        e->key = key;
+        rate_limiter_init(&e->limiter, table->rate, table->clock);
+        e->next = table->buckets[key % NUM_BUCKETS];
+        table->buckets[key % NUM_BUCKETS] = e;
+        ++table->size;
+    }
+    result = rate_limiter_wait_nosleep(&e->limiter, size);
+    pthread_rwlock_unlock(&table->lock);
+    return result;
+}
+
+void rate_limiter_table_set_rate(RateLimiterTable *table, double rate)
+{
+    pthread_rwlock_wrlock(&table->lock);
+    table->rate = rate;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        for (struct entry *e = table->buckets[i]; e != NULL; e = e->next) {
+            rate_limiter_set_rate(&e->limiter, rate);
+        }
+    }
+    pthread_rwlock_unlock(&table->lock);
+}
+
+size_t rate_limiter_table_size(RateLimiterTable *table)
+{
+    pthread_rwlock_rdlock(&table->lock);
+    size_t size = table->size;
+    pthread_rwlock_unlock(&table->lock);
+    return size;
+}
+
+void rate_limiter_table_destroy(RateLimiterTable *table)
+{
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        struct entry *e = table->buckets[i];
+        while (e != NULL) {
+            struct entry *next = e->next;
+            rate_limiter_destroy(&e->limiter);
+            free(e);
+            e = next;
+        }
+    }
+    pthread_rwlock_destroy(&table->lock);
+    free(table);
+}
@@ -0,0 +1,44 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_RATE_LIMITER_TABLE_H
+#define INC_BINDFS_RATE_LIMITER_TABLE_H
+
+#include "rate_limiter.h"
+
+/* A set of rate limiters with the same rate, one per key (e.g. uid).
+ *
+ * Limiters are created on first use. A limiter that has been idle long
+ * enough to be back in its initial state is indistinguishable from a new
+ * one, so such limiters are reclaimed when new keys are added. */
+typedef struct RateLimiterTable RateLimiterTable;
+
+RateLimiterTable *rate_limiter_table_create(double rate, double (*clock)(void));
+/* Blocks until the limiter for `key` clears `size` units. */
+void rate_limiter_table_wait(RateLimiterTable *table, unsigned int key, size_t size);
+/* Like `rate_limiter_wait_nosleep` for the limiter of `key`. */
+double rate_limiter_table_wait_nosleep(RateLimiterTable *table, unsigned int key, size_t size);
+/* Changes the rate of all current and future limiters. */
+void rate_limiter_table_set_rate(RateLimiterTable *table, double rate);
+/* The number of limiters currently allocated. */
+size_t rate_limiter_table_size(RateLimiterTable *table);
+/* Destroys the table. No wait calls may be active. */
+void rate_limiter_table_destroy(RateLimiterTable *table);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "readahead.h"
+
+#include <fcntl.h>
+
+/* Reads in a row before a stream counts as sequential or random. */
+static const int sequential_threshold = 2;
+static const int random_threshold = 4;
+
+/* The first WILLNEED window, as a multiple of the read size. */
+static const size_t initial_window_reads = 4;
+
+#ifdef HAVE_POSIX_FADVISE
+static void advise(int fd, off_t offset, off_t len, int advice)
+{
+    posix_fadvise(fd, offset, len, advice);
+}
+#else
+#define POSIX_FADV_NORMAL 0
+#define POSIX_FADV_RANDOM 1
+#define POSIX_FADV_WILLNEED 3
+static void advise(int fd, off_t offset, off_t len, int advice)
+{
+    (void)fd;
+    (void)offset;
+    (void)len;
+    (void)advice;
+}
+#endif
+
+void readahead_init(struct readahead_state *ra, size_t max_window)
+{
+    pthread_mutex_init(&ra->mutex, NULL);
+    ra->max_window = max_window;
+    ra->next_offset = -1;
+    ra->hinted_end = 0;
+    ra->window = 0;
+    ra->sequential_reads = 0;
+    ra->random_reads = 0;
+    ra->random_mode = false;
+}
+
+static enum readahead_advice on_sequential(struct readahead_state *ra, int fd,
+                                           off_t offset, size_t size)
+{
+    enum readahead_advice result = READAHEAD_NONE;
+
+    ra->random_reads = 0;
+    if (++ra->sequential_reads < sequential_threshold) {
+        return result;
+    }
+
+    if (ra->random_mode) {
+        advise(fd, 0, 0, POSIX_FADV_NORMAL);
+        ra->random_mode = false;
+    }
+
+    if (ra->window == 0) {
+        ra->window = size * initial_window_reads;
+    } else if (ra->window < ra->max_window) {
+        ra->window *= 2;
+    }
+    if (ra->window > ra->max_window) {
+        ra->window = ra->max_window;
+    }
+
+    /* Hint again once the reader has consumed half of the hinted range,
+       so that each hint covers a worthwhile chunk. */
+    off_t read_end = offset + (off_t)size;
+    off_t target_end = read_end + (off_t)ra->window;
+    if (target_end - ra->hinted_end >= (off_t)(ra->window / 2)) {
+        off_t start = ra->hinted_end > read_end ? ra->hinted_end : read_end;
+        advise(fd, start, target_end - start, POSIX_FADV_WILLNEED);
+        ra->hinted_end = target_end;
+        result = READAHEAD_WILLNEED;
+    }
+
+    return result;
+}
+
+static enum readahead_advice on_random(struct readahead_state *ra, int fd)
+{
+    ra->sequential_reads = 0;
+    ra->window = 0;
+    ra->hinted_end = 0;
+
+    if (++ra->random_reads >= random_threshold && !ra->random_mode) {
+        advise(fd, 0, 0, POSIX_FADV_RANDOM);
+        ra->random_mode = true;
+        return READAHEAD_RANDOM;
+    }
+    return READAHEAD_NONE;
+}
+
+enum readahead_advice readahead_note_read(struct readahead_state *ra, int fd,
+                                          off_t offset, size_t size)
+{
+    enum readahead_advice result;
+
+    if (size == 0 || pthread_mutex_trylock(&ra->mutex) != 0) {
+        return READAHEAD_NONE;
+    }
+
+    if (offset == ra->next_offset) {
+        result = on_sequential(ra, fd, offset, size);
+    } else {
+        result = on_random(ra, fd);
+    }
+    ra->next_offset = offset + (off_t)size;
+
+    pthread_mutex_unlock(&ra->mutex);
+    return result;
+}
+
+void readahead_destroy(struct readahead_state *ra)
+{
+    pthread_mutex_destroy(&ra->mutex);
+}
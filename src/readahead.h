@@ -0,0 +1,59 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_READAHEAD_H
+#define INC_BINDFS_READAHEAD_H
+
+#include <config.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Watches the reads of one open file and gives the source filesystem
+ * hints with posix_fadvise(): WILLNEED ahead of a sequential reader, with a
+ * window that doubles up to a maximum, and RANDOM when reads jump around. */
+struct readahead_state {
+    pthread_mutex_t mutex;
+    size_t max_window;
+    off_t next_offset;   /* Where a sequential read would continue. */
+    off_t hinted_end;    /* End of the range already hinted with WILLNEED. */
+    size_t window;
+    int sequential_reads;
+    int random_reads;
+    bool random_mode;
+};
+
+enum readahead_advice {
+    READAHEAD_NONE,
+    READAHEAD_WILLNEED,
+    READAHEAD_RANDOM
+};
+
+void readahead_init(struct readahead_state *ra, size_t max_window);
+
+/* Call after reading `size` bytes at `offset` from `fd`.
+ * Returns the advice given, mainly for tests. If another thread is
+ * already updating `ra`, does nothing rather than wait. */
+enum readahead_advice readahead_note_read(struct readahead_state *ra, int fd,
+                                          off_t offset, size_t size);
+
+void readahead_destroy(struct readahead_state *ra);
+
+#endif
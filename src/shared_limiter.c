@@ -0,0 +1,175 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include "shared_limiter.h"
+#include "rate_limiter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHARED_LIMITER_MAGIC 0x62667372u  /* "bfsr" */
+#define SHARED_LIMITER_VERSION 1
+#define MAX_NAME_LEN 20  /* macOS limits shm names to 31 characters. */
+
+struct segment {
+    uint32_t magic;    /* Set last by the creator. */
+    uint32_t version;
+    double theoretical_arrival_time[NUM_SHARED_BUCKETS];  /* On monotonic_clock. */
+};
+
+struct SharedLimiter {
+    struct segment *segment;
+};
+
+static void segment_path(const char *name, char *buf, size_t buf_size)
+{
+    snprintf(buf, buf_size, "/bindfs-%s", name);
+}
+
+int shared_limiter_valid_name(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0 || len > MAX_NAME_LEN) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Waits for another process to finish creating the segment. */
+static int wait_for_creator(int fd, struct segment *seg)
+{
+    for (int i = 0; i < 100; ++i) {
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            return -1;
+        }
+        if ((size_t)st.st_size >= sizeof(struct segment) &&
+            __atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == SHARED_LIMITER_MAGIC) {
+            if (seg->version != SHARED_LIMITER_VERSION) {
+                errno = EPROTO;
+                return -1;
+            }
+            return 0;
+        }
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    errno = ETIMEDOUT;
+    return -1;
+}
+
+SharedLimiter *shared_limiter_open(const char *name)
+{
+    char path[64];
+    int created = 1;
+
+    if (!shared_limiter_valid_name(name)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    segment_path(name, path, sizeof(path));
+
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1 && errno == EEXIST) {
+        created = 0;
+        fd = shm_open(path, O_RDWR, 0);
+    }
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (created && ftruncate(fd, sizeof(struct segment)) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        shm_unlink(path);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    struct segment *seg = mmap(NULL, sizeof(struct segment), PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    if (created) {
+        double now = monotonic_clock();
+        seg->version = SHARED_LIMITER_VERSION;
+        for (int i = 0; i < NUM_SHARED_BUCKETS; ++i) {
+            seg->theoretical_arrival_time[i] = now + rate_limiter_get_idle_credit();
+        }
+        __atomic_store_n(&seg->magic, SHARED_LIMITER_MAGIC, __ATOMIC_RELEASE);
+    } else if (wait_for_creator(fd, seg) == -1) {
+        int saved_errno = errno;
+        munmap(seg, sizeof(struct segment));
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    close(fd);
+
+    SharedLimiter *sl = malloc(sizeof(SharedLimiter));
+    if (sl == NULL) {
+        munmap(seg, sizeof(struct segment));
+        errno = ENOMEM;
+        return NULL;
+    }
+    sl->segment = seg;
+    return sl;
+}
+
+double shared_limiter_wait_nosleep(SharedLimiter *sl, enum SharedBucket bucket,
+                                   double rate, size_t size)
+{
+    return rate_limiter_update_tat(&sl->segment->theoretical_arrival_time[bucket],
+                                   monotonic_clock(), size / rate);
+}
+
+void shared_limiter_close(SharedLimiter *sl)
+{
+    munmap(sl->segment, sizeof(struct segment));
+    free(sl);
+}
+
+int shared_limiter_remove(const char *name)
+{
+    char path[64];
+    segment_path(name, path, sizeof(path));
+    return shm_unlink(path);
+}
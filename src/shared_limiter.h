@@ -0,0 +1,54 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_SHARED_LIMITER_H
+#define INC_BINDFS_SHARED_LIMITER_H
+
+#include <stddef.h>
+
+/* Token buckets in a named shared memory segment (shm_open), so that
+ * several bindfs processes can share one rate limit.
+ *
+ * The segment holds the state of a read and a write bucket, updated with
+ * atomic compare-and-swap on the system-wide monotonic clock. Each process
+ * passes its own rate, so all processes sharing a segment should use the
+ * same rates. The segment is never removed by bindfs. */
+
+enum SharedBucket {
+    SHARED_BUCKET_READ,
+    SHARED_BUCKET_WRITE,
+    NUM_SHARED_BUCKETS
+};
+
+typedef struct SharedLimiter SharedLimiter;
+
+/* Whether `name` is acceptable as a segment name. */
+int shared_limiter_valid_name(const char *name);
+/* Attaches to the segment for `name`, creating it if needed.
+ * Returns NULL and sets errno on error. */
+SharedLimiter *shared_limiter_open(const char *name);
+/* Like `rate_limiter_wait_nosleep` for one of the buckets. */
+double shared_limiter_wait_nosleep(SharedLimiter *sl, enum SharedBucket bucket,
+                                   double rate, size_t size);
+/* Detaches from the segment. */
+void shared_limiter_close(SharedLimiter *sl);
+/* Removes the segment for `name`. Processes attached to it keep using it. */
+int shared_limiter_remove(const char *name);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stats.h"
+#include "histogram.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct op_stats {
+    unsigned long long count;
+    unsigned long long errors;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long histogram[HISTOGRAM_BUCKETS];
+};
+
+struct shard {
+    struct shard *next;
+    struct op_stats ops[];  /* `num_ops` of them */
+};
+
+static const char *op_names[STATS_MAX_OPS];
+static int num_ops = 0;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shard_key;
+
+/* Protects the list of shards and `retired`, not their counters. */
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shard *shards = NULL;
+static struct shard *retired = NULL;  /* Sums of the shards of exited threads. */
+
+/* Only the owning thread writes to a shard, so a plain load and an atomic
+   store are enough, and readers never see torn values. */
+static void add(unsigned long long *counter, unsigned long long amount)
+{
+    __atomic_store_n(counter, *counter + amount, __ATOMIC_RELAXED);
+}
+
+static struct shard *new_shard(void)
+{
+    return calloc(1, sizeof(struct shard) + num_ops * sizeof(struct op_stats));
+}
+
+static void merge_into(struct shard *dest, struct shard *src)
+{
+    for (int i = 0; i < num_ops; ++i) {
+        struct op_stats *d = &dest->ops[i];
+        struct op_stats *s = &src->ops[i];
+        d->count += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+        d->errors += __atomic_load_n(&s->errors, __ATOMIC_RELAXED);
+        d->total_ns += __atomic_load_n(&s->total_ns, __ATOMIC_RELAXED);
+        unsigned long long max_ns = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+        if (max_ns > d->max_ns) {
+            d->max_ns = max_ns;
+        }
+        for (int j = 0; j < HISTOGRAM_BUCKETS; ++j) {
+            d->histogram[j] += __atomic_load_n(&s->histogram[j], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void retire_shard(void *arg)
+{
+    struct shard *shard = arg;
+    pthread_mutex_lock(&shards_lock);
+    struct shard **prev = &shards;
+    while (*prev != shard) {
+        prev = &(*prev)->next;
+    }
+    *prev = shard->next;
+    if (retired == NULL) {
+        retired = new_shard();
+    }
+    if (retired != NULL) {
+        merge_into(retired, shard);
+    }
+    pthread_mutex_unlock(&shards_lock);
+    free(shard);
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&shard_key, &retire_shard);
+}
+
+static struct shard *get_shard(void)
+{
+    struct shard *shard = pthread_getspecific(shard_key);
+    if (shard == NULL) {
+        shard = new_shard();
+        if (shard == NULL) {
+            return NULL;
+        }
+        pthread_setspecific(shard_key, shard);
+        pthread_mutex_lock(&shards_lock);
+        shard->next = shards;
+        shards = shard;
+        pthread_mutex_unlock(&shards_lock);
+    }
+    return shard;
+}
+
+int stats_register_op(const char *name)
+{
+    pthread_once(&key_once, &create_key);
+    if (num_ops == STATS_MAX_OPS) {
+        return -1;
+    }
+    op_names[num_ops] = name;
+    return num_ops++;
+}
+
+void stats_record(int op, double latency, int failed)
+{
+    if (op < 0) {
+        return;
+    }
+    struct shard *shard = get_shard();
+    if (shard == NULL) {
+        return;
+    }
+    struct op_stats *st = &shard->ops[op];
+    unsigned long long ns = latency > 0 ? (unsigned long long)(latency * 1e9) : 0;
+    add(&st->count, 1);
+    if (failed) {
+        add(&st->errors, 1);
+    }
+    add(&st->total_ns, ns);
+    if (ns > st->max_ns) {
+        __atomic_store_n(&st->max_ns, ns, __ATOMIC_RELAXED);
+    }
+    add(&st->histogram[histogram_bucket(latency)], 1);
+}
+
+void stats_print(FILE *f)
+{
+    struct shard *sum = new_shard();
+    if (sum == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&shards_lock);
+    for (struct shard *s = shards; s != NULL; s = s->next) {
+        merge_into(sum, s);
+    }
+    if (retired != NULL) {
+        merge_into(sum, retired);
+    }
+    pthread_mutex_unlock(&shards_lock);
+
+    fprintf(f, "%-16s %12s %10s %10s %10s %10s %10s %10s\n",
+            "op", "count", "errors", "mean_us", "p50_us", "p90_us", "p99_us", "max_us");
+    for (int i = 0; i < num_ops; ++i) {
+        struct op_stats *st = &sum->ops[i];
+        if (st->count == 0) {
+            continue;
+        }
+        fprintf(f, "%-16s %12llu %10llu %10.1f %10.0f %10.0f %10.0f %10.1f\n",
+                op_names[i], st->count, st->errors,
+                st->total_ns / 1000.0 / st->count,
+                histogram_percentile(st->histogram, st->count, 0.50) * 1e6,
+                histogram_percentile(st->histogram, st->count, 0.90) * 1e6,
+                histogram_percentile(st->histogram, st->count, 0.99) * 1e6,
+                st->max_ns / 1000.0);
+    }
+    free(sum);
+}
@@ -0,0 +1,41 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_STATS_H
+#define INC_BINDFS_STATS_H
+
+#include <stdio.h>
+
+/* Per-operation counts, errors and latency histograms.
+ *
+ * Each thread records into its own shard, so recording takes no locks and
+ * does no atomic read-modify-writes. Shards are summed when printing, and
+ * a thread's shard is folded into a common one when the thread exits. */
+
+#define STATS_MAX_OPS 64
+
+/* Registers an operation and returns its ID for `stats_record`.
+   Must be called before any operation is recorded. */
+int stats_register_op(const char *name);
+/* Records an operation that took `latency` seconds. */
+void stats_record(int op, double latency, int failed);
+/* Prints a table of the operations done so far. */
+void stats_print(FILE *f);
+
+#endif
@@ -0,0 +1,363 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+struct ring {
+    uint64_t head;     /* Only written by the owner thread. */
+    uint64_t tail;     /* Only written by the drainer. */
+    uint64_t dropped;  /* Events that didn't fit since the last drain. */
+    uint32_t tid;
+    bool retired;      /* The owner thread has exited. */
+    struct ring *next;
+    struct trace_event events[TRACE_RING_SIZE];
+};
+
+static char op_names[TRACE_MAX_OPS][TRACE_OP_NAME_LEN];
+static int num_ops = 0;
+
+static bool started = false;
+static bool tracing = false;  /* Cleared early if the file reaches its maximum size. */
+static pthread_key_t ring_key;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;  /* Protects `rings` */
+static struct ring *rings = NULL;
+
+static pthread_mutex_t drainer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drainer_cond = PTHREAD_COND_INITIALIZER;  /* Stopping */
+static pthread_t drainer_thread;
+static bool drainer_stopping = false;
+static unsigned int drain_interval_ms;
+static int output_fd = -1;
+static bool output_failed = false;
+static uint64_t output_size = 0;
+static uint64_t max_output_size = 0;  /* 0 for no limit. */
+static bool output_full = false;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t current_tid(void)
+{
+#ifdef __linux__
+    return (uint32_t)syscall(SYS_gettid);
+#else
+    static uint32_t next_tid = 0;
+    return __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static void retire_ring(void *arg)
+{
+    struct ring *r = arg;
+    __atomic_store_n(&r->retired, true, __ATOMIC_RELEASE);
+}
+
+static struct ring *get_ring(void)
+{
+    struct ring *r = pthread_getspecific(ring_key);
+    if (r == NULL) {
+        r = calloc(1, sizeof(struct ring));
+        if (r == NULL) {
+            return NULL;
+        }
+        r->tid = current_tid();
+        pthread_setspecific(ring_key, r);
+        pthread_mutex_lock(&rings_lock);
+        r->next = rings;
+        rings = r;
+        pthread_mutex_unlock(&rings_lock);
+    }
+    return r;
+}
+
+static void append(struct ring *r, struct trace_event *e)
+{
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (r->head - tail >= TRACE_RING_SIZE) {
+        __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    r->events[r->head % TRACE_RING_SIZE] = *e;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_enter(int op, const char *path)
+{
+    if (!__atomic_load_n(&tracing, __ATOMIC_RELAXED) || op < 0) {
+        return;
+    }
+    struct ring *r = get_ring();
+    if (r == NULL) {
+        return;
+    }
+
+    struct trace_event e;
+    memset(&e, 0, sizeof(e));
+    e.time_ns = now_ns();
+    e.tid = r->tid;
+    e.op = (uint16_t)op;
+    e.type = TRACE_ENTER;
+    if (path != NULL) {
+        /* The end of a path tells more than the beginning. */
+        size_t len = strlen(path);
+        size_t skip = len < TRACE_PATH_LEN ? 0 : len - (TRACE_PATH_LEN - 1);
+        memcpy(e.path, path + skip, len - skip);
+    }
+    append(r, &e);
+}
+
+void trace_exit(int op, int64_t result)
+{
+    if (!__atomic_load_n(&tracing, __ATOMIC_RELAXED) || op < 0) {
+        return;
+    }
+    struct ring *r = get_ring();
+    if (r == NULL) {
+        return;
+    }
+
+    struct trace_event e;
+    memset(&e, 0, sizeof(e));
+    e.time_ns = now_ns();
+    e.tid = r->tid;
+    e.op = (uint16_t)op;
+    e.type = TRACE_EXIT;
+    e.result = result;
+    append(r, &e);
+}
+
+int trace_register_op(const char *name)
+{
+    if (num_ops >= TRACE_MAX_OPS) {
+        return -1;
+    }
+    snprintf(op_names[num_ops], TRACE_OP_NAME_LEN, "%s", name);
+    return num_ops++;
+}
+
+static void write_output(const void *buf, size_t size)
+{
+    const char *p = buf;
+    while (size > 0 && !output_failed) {
+        ssize_t res = write(output_fd, p, size);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            output_failed = true;  /* Keep draining so that threads don't drop events forever. */
+            return;
+        }
+        p += res;
+        size -= res;
+        output_size += res;
+    }
+}
+
+/* How many more events fit in the file, keeping room for the final
+   TRACE_TRUNCATED event. */
+static uint64_t room_for_events(void)
+{
+    uint64_t event_size = sizeof(struct trace_event);
+    if (max_output_size == 0) {
+        return UINT64_MAX;
+    }
+    if (output_size + event_size > max_output_size) {
+        return 0;
+    }
+    return (max_output_size - output_size - event_size) / event_size;
+}
+
+/* Ends the trace with a TRACE_TRUNCATED event and stops recording. */
+static void truncate_output(void)
+{
+    struct trace_event e;
+    memset(&e, 0, sizeof(e));
+    e.time_ns = now_ns();
+    e.type = TRACE_TRUNCATED;
+    e.result = (int64_t)max_output_size;
+    write_output(&e, sizeof(e));
+    output_full = true;
+    __atomic_store_n(&tracing, false, __ATOMIC_RELAXED);
+}
+
+/* Writes out the events in all rings and frees the rings of exited threads. */
+static void drain(void)
+{
+    pthread_mutex_lock(&rings_lock);
+    struct ring **link = &rings;
+    while (*link != NULL) {
+        struct ring *r = *link;
+        /* Once retired, the owner won't add events after the head we read. */
+        bool retired = __atomic_load_n(&r->retired, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = r->tail;
+        while (tail < head && !output_full) {
+            size_t start = tail % TRACE_RING_SIZE;
+            uint64_t count = head - tail;
+            if (count > TRACE_RING_SIZE - start) {
+                count = TRACE_RING_SIZE - start;
+            }
+            uint64_t room = room_for_events();
+            if (room == 0) {
+                truncate_output();
+                break;
+            }
+            if (count > room) {
+                count = room;
+            }
+            write_output(&r->events[start], count * sizeof(struct trace_event));
+            tail += count;
+        }
+        if (output_full) {
+            tail = head;  /* Discard what was recorded before we stopped. */
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+        uint64_t dropped = __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0 && !output_full) {
+            if (room_for_events() == 0) {
+                truncate_output();
+            } else {
+                struct trace_event e;
+                memset(&e, 0, sizeof(e));
+                e.time_ns = now_ns();
+                e.tid = r->tid;
+                e.type = TRACE_DROPPED;
+                e.result = (int64_t)dropped;
+                write_output(&e, sizeof(e));
+            }
+        }
+
+        if (retired) {
+            *link = r->next;
+            free(r);
+        } else {
+            link = &r->next;
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+}
+
+static void *drainer_main(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&drainer_mutex);
+    while (!drainer_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += drain_interval_ms / 1000;
+        deadline.tv_nsec += (long)(drain_interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&drainer_cond, &drainer_mutex, &deadline);
+
+        pthread_mutex_unlock(&drainer_mutex);
+        drain();
+        pthread_mutex_lock(&drainer_mutex);
+    }
+    pthread_mutex_unlock(&drainer_mutex);
+
+    return NULL;
+}
+
+int trace_start(int fd, unsigned int interval_ms, uint64_t max_size)
+{
+    output_fd = fd;
+    output_failed = false;
+    output_size = 0;
+    max_output_size = max_size;
+    output_full = false;
+
+    struct trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.num_ops = num_ops;
+    write_output(&header, sizeof(header));
+    write_output(op_names, num_ops * TRACE_OP_NAME_LEN);
+    if (output_failed) {
+        return errno;
+    }
+
+    int res = pthread_key_create(&ring_key, &retire_ring);
+    if (res != 0) {
+        return res;
+    }
+
+    pthread_mutex_lock(&drainer_mutex);
+    drain_interval_ms = interval_ms;
+    drainer_stopping = false;
+    res = pthread_create(&drainer_thread, NULL, &drainer_main, NULL);
+    pthread_mutex_unlock(&drainer_mutex);
+    if (res != 0) {
+        pthread_key_delete(ring_key);
+        return res;
+    }
+
+    started = true;
+    __atomic_store_n(&tracing, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_stop(void)
+{
+    if (!started) {
+        return;
+    }
+    started = false;
+    __atomic_store_n(&tracing, false, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&drainer_mutex);
+    drainer_stopping = true;
+    pthread_cond_signal(&drainer_cond);
+    pthread_mutex_unlock(&drainer_mutex);
+    pthread_join(drainer_thread, NULL);
+
+    /* No operations run anymore, so the remaining rings can go too. */
+    drain();
+    pthread_mutex_lock(&rings_lock);
+    while (rings != NULL) {
+        struct ring *r = rings;
+        rings = r->next;
+        free(r);
+    }
+    pthread_mutex_unlock(&rings_lock);
+    pthread_key_delete(ring_key);
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_TRACE_H
+#define INC_BINDFS_TRACE_H
+
+#include <stdint.h>
+
+/* A binary trace of operation entries and exits.
+ *
+ * Each thread appends fixed-size events to its own ring buffer, which
+ * takes no locks and makes no system calls beyond reading the clock.
+ * A background thread drains the rings to a file. If a ring is full, new
+ * events are dropped and a TRACE_DROPPED event records how many.
+ * If the file reaches its maximum size, it ends with a TRACE_TRUNCATED
+ * event and nothing more is recorded. bindfs-trace decodes the file. */
+
+#define TRACE_MAGIC "bfstrace"
+#define TRACE_VERSION 1
+#define TRACE_MAX_OPS 64
+#define TRACE_OP_NAME_LEN 24
+#define TRACE_PATH_LEN 40
+#define TRACE_RING_SIZE 4096  /* Events per thread. */
+
+enum TraceEventType {
+    TRACE_ENTER,
+    TRACE_EXIT,
+    TRACE_DROPPED,
+    TRACE_TRUNCATED
+};
+
+/* The file starts with this, followed by `num_ops` names of
+   TRACE_OP_NAME_LEN bytes each, followed by events. */
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_ops;
+};
+
+struct trace_event {
+    uint64_t time_ns;  /* On CLOCK_MONOTONIC. */
+    uint32_t tid;
+    uint16_t op;
+    uint8_t type;  /* enum TraceEventType */
+    uint8_t reserved;
+    int64_t result;  /* TRACE_EXIT: the return value, a negative errno on error.
+                        TRACE_DROPPED: the number of events dropped.
+                        TRACE_TRUNCATED: the maximum size of the file. */
+    char path[TRACE_PATH_LEN];  /* TRACE_ENTER: the end of the path, NUL-terminated. */
+};
+
+/* Returns an ID for `trace_enter` and `trace_exit`, or -1 if there is no
+   room. Must be called before `trace_start`. */
+int trace_register_op(const char *name);
+/* Writes the header to `fd` and starts draining events to it every
+   `interval_ms`, until the file would exceed `max_size` bytes (0 for no
+   limit). Returns 0 or an error number. */
+int trace_start(int fd, unsigned int interval_ms, uint64_t max_size);
+/* Drains the remaining events and stops the drainer thread.
+   Must not be called while other threads may record events.
+   Doesn't close the file. */
+void trace_stop(void);
+
+/* These do nothing unless started. `path` may be NULL. */
+void trace_enter(int op, const char *path);
+void trace_exit(int op, int64_t result);
+
+#endif
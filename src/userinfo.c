@@ -20,6 +20,8 @@
 #include "userinfo.h"
 #include "misc.h"
 #include "debug.h"
+#include "metrics.h"
+#include "probes.h"
 
 #include <signal.h>
 #include <stdlib.h>
@@ -352,6 +354,8 @@ void init_user_cache(void)
     if (cache_rebuild_requested) {
         DPRINTF("Building user/group cache");
         cache_rebuild_requested = 0;
+        metrics_add(METRIC_USER_CACHE_REBUILDS, 1);
+        BINDFS_PROBE0(user__cache__rebuild__start);
 
         free_memory_block(&cache_memory_block);
         init_memory_block(&cache_memory_block, 1024);
@@ -359,6 +363,7 @@ void init_user_cache(void)
         rebuild_gid_cache();
         qsort(uid_cache, uid_cache_size, sizeof(struct uid_cache_entry), uid_cache_uid_sortcmp);
         qsort(gid_cache, gid_cache_size, sizeof(struct gid_cache_entry), gid_cache_gid_sortcmp);
+        BINDFS_PROBE0(user__cache__rebuild__done);
     }
     pthread_rwlock_unlock(&cache_lock);
 }
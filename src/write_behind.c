@@ -0,0 +1,417 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "write_behind.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+struct write_behind {
+    pthread_mutex_t mutex;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+
+    char *buf;
+    size_t capacity;
+    size_t len;
+    off_t offset;  /* File offset of buf[0]. */
+
+    int error;  /* Deferred error number from a background flush, or 0. */
+
+    /* One reference is held by the owner until write_behind_close,
+       and one by each snapshot that includes the buffer. */
+    unsigned int refs;
+
+    /* Buffers are in a hash table keyed by (dev, ino). */
+    struct write_behind *prev;
+    struct write_behind *next;
+};
+
+#define REGISTRY_BUCKETS 256
+
+/* Protects only the table. It is never held while taking a buffer's mutex,
+   so I/O on one buffer doesn't hold up lookups of the others. */
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct write_behind *registry[REGISTRY_BUCKETS];
+static size_t registry_count = 0;
+
+/* The number of buffers holding data. Lets lookups skip the registry
+   entirely in the common case that nothing is buffered. */
+static size_t num_dirty = 0;
+
+static pthread_mutex_t flusher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher_thread;
+static bool flusher_running = false;
+static bool flusher_stopping = false;
+static unsigned int flusher_interval_ms;
+
+static int write_fully(int fd, const char *buf, size_t size, off_t offset)
+{
+    while (size > 0) {
+        ssize_t res = pwrite(fd, buf, size, offset);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        buf += res;
+        size -= res;
+        offset += res;
+    }
+    return 0;
+}
+
+/* Must hold wb->mutex. The buffer is emptied even on error. */
+static int flush_locked(struct write_behind *wb)
+{
+    int res = 0;
+    if (wb->len > 0) {
+        res = write_fully(wb->fd, wb->buf, wb->len, wb->offset);
+        wb->len = 0;
+        __atomic_sub_fetch(&num_dirty, 1, __ATOMIC_RELEASE);
+    }
+    return res;
+}
+
+static bool anything_dirty(void)
+{
+    return __atomic_load_n(&num_dirty, __ATOMIC_ACQUIRE) > 0;
+}
+
+static size_t bucket_of(dev_t dev, ino_t ino)
+{
+    return ((size_t)dev * 31 + (size_t)ino) % REGISTRY_BUCKETS;
+}
+
+static void release(struct write_behind *wb)
+{
+    if (__atomic_sub_fetch(&wb->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_destroy(&wb->mutex);
+        free(wb->buf);
+        free(wb);
+    }
+}
+
+static void release_snapshot(struct write_behind **snapshot, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        release(snapshot[i]);
+    }
+    free(snapshot);
+}
+
+/* Sets *snapshot to the buffers of the given file, or all buffers if `all`,
+   each with a reference that release_snapshot drops.
+   Returns 0 or -ENOMEM. */
+static int take_snapshot(bool all, dev_t dev, ino_t ino,
+                         struct write_behind ***snapshot_out, size_t *count)
+{
+    struct write_behind **snapshot = NULL;
+    size_t n = 0;
+    int res = 0;
+
+    pthread_mutex_lock(&registry_mutex);
+    size_t first = all ? 0 : bucket_of(dev, ino);
+    size_t last = all ? REGISTRY_BUCKETS : first + 1;
+    size_t max = all ? registry_count : 0;
+    if (!all) {
+        for (struct write_behind *wb = registry[first]; wb != NULL; wb = wb->next) {
+            max += (wb->dev == dev && wb->ino == ino);
+        }
+    }
+    if (max > 0) {
+        snapshot = malloc(max * sizeof(struct write_behind *));
+        if (snapshot == NULL) {
+            res = -ENOMEM;
+        }
+    }
+    if (snapshot != NULL) {
+        for (size_t i = first; i < last; ++i) {
+            for (struct write_behind *wb = registry[i]; wb != NULL; wb = wb->next) {
+                if (all || (wb->dev == dev && wb->ino == ino)) {
+                    __atomic_add_fetch(&wb->refs, 1, __ATOMIC_RELAXED);
+                    snapshot[n++] = wb;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    *snapshot_out = snapshot;
+    *count = n;
+    return res;
+}
+
+/* Must hold wb->mutex. Returns and clears any deferred error. */
+static int take_error_locked(struct write_behind *wb)
+{
+    int error = wb->error;
+    wb->error = 0;
+    return -error;
+}
+
+static void flush_all(bool wait)
+{
+    if (!anything_dirty()) {
+        return;
+    }
+
+    /* On failure, the buffers are flushed on the next round or when closed. */
+    struct write_behind **snapshot;
+    size_t count;
+    take_snapshot(true, 0, 0, &snapshot, &count);
+    for (size_t i = 0; i < count; ++i) {
+        struct write_behind *wb = snapshot[i];
+        if (wait) {
+            pthread_mutex_lock(&wb->mutex);
+        } else if (pthread_mutex_trylock(&wb->mutex) != 0) {
+            continue;  /* A writer is busy with it anyway. */
+        }
+        int res = flush_locked(wb);
+        if (res != 0 && wb->error == 0) {
+            wb->error = -res;
+        }
+        pthread_mutex_unlock(&wb->mutex);
+    }
+    release_snapshot(snapshot, count);
+}
+
+static void *flusher_main(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&flusher_mutex);
+    while (!flusher_stopping) {
+        struct timeval now;
+        struct timespec deadline;
+        gettimeofday(&now, NULL);
+        long nsec = now.tv_usec * 1000L + (long)(flusher_interval_ms % 1000) * 1000000L;
+        deadline.tv_sec = now.tv_sec + flusher_interval_ms / 1000 + nsec / 1000000000L;
+        deadline.tv_nsec = nsec % 1000000000L;
+        pthread_cond_timedwait(&flusher_cond, &flusher_mutex, &deadline);
+        if (flusher_stopping) {
+            break;
+        }
+
+        pthread_mutex_unlock(&flusher_mutex);
+        flush_all(false);
+        pthread_mutex_lock(&flusher_mutex);
+    }
+    pthread_mutex_unlock(&flusher_mutex);
+
+    return NULL;
+}
+
+int write_behind_start(unsigned int interval_ms)
+{
+    pthread_mutex_lock(&flusher_mutex);
+    flusher_interval_ms = interval_ms;
+    flusher_stopping = false;
+    int res = pthread_create(&flusher_thread, NULL, &flusher_main, NULL);
+    flusher_running = (res == 0);
+    pthread_mutex_unlock(&flusher_mutex);
+    return res;
+}
+
+void write_behind_stop(void)
+{
+    pthread_mutex_lock(&flusher_mutex);
+    bool was_running = flusher_running;
+    flusher_stopping = true;
+    flusher_running = false;
+    pthread_cond_signal(&flusher_cond);
+    pthread_mutex_unlock(&flusher_mutex);
+
+    if (was_running) {
+        pthread_join(flusher_thread, NULL);
+    }
+    flush_all(true);
+}
+
+struct write_behind *write_behind_create(int fd, size_t capacity)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return NULL;
+    }
+
+    struct write_behind *wb = malloc(sizeof(struct write_behind));
+    if (wb == NULL) {
+        return NULL;
+    }
+    wb->buf = malloc(capacity);
+    if (wb->buf == NULL) {
+        free(wb);
+        return NULL;
+    }
+
+    pthread_mutex_init(&wb->mutex, NULL);
+    wb->fd = fd;
+    wb->dev = st.st_dev;
+    wb->ino = st.st_ino;
+    wb->capacity = capacity;
+    wb->len = 0;
+    wb->offset = 0;
+    wb->error = 0;
+    wb->refs = 1;
+
+    size_t bucket = bucket_of(wb->dev, wb->ino);
+    pthread_mutex_lock(&registry_mutex);
+    wb->prev = NULL;
+    wb->next = registry[bucket];
+    if (registry[bucket] != NULL) {
+        registry[bucket]->prev = wb;
+    }
+    registry[bucket] = wb;
+    ++registry_count;
+    pthread_mutex_unlock(&registry_mutex);
+
+    return wb;
+}
+
+ssize_t write_behind_write(struct write_behind *wb, const char *buf, size_t size, off_t offset)
+{
+    int res;
+
+    pthread_mutex_lock(&wb->mutex);
+
+    res = take_error_locked(wb);
+    if (res != 0) {
+        goto out;
+    }
+
+    bool extends = wb->len > 0 && offset == wb->offset + (off_t)wb->len;
+    if (extends && wb->len + size <= wb->capacity) {
+        memcpy(wb->buf + wb->len, buf, size);
+        wb->len += size;
+        goto out;
+    }
+
+    res = flush_locked(wb);
+    if (res != 0) {
+        goto out;
+    }
+
+    if (size <= wb->capacity) {
+        memcpy(wb->buf, buf, size);
+        wb->len = size;
+        wb->offset = offset;
+        if (size > 0) {
+            __atomic_add_fetch(&num_dirty, 1, __ATOMIC_RELEASE);
+        }
+    } else {
+        res = write_fully(wb->fd, buf, size, offset);
+    }
+
+out:
+    pthread_mutex_unlock(&wb->mutex);
+    return res != 0 ? res : (ssize_t)size;
+}
+
+int write_behind_flush(struct write_behind *wb)
+{
+    pthread_mutex_lock(&wb->mutex);
+    int res = flush_locked(wb);
+    int deferred = take_error_locked(wb);
+    pthread_mutex_unlock(&wb->mutex);
+    return deferred != 0 ? deferred : res;
+}
+
+int write_behind_close(struct write_behind *wb)
+{
+    pthread_mutex_lock(&registry_mutex);
+    if (wb->prev != NULL) {
+        wb->prev->next = wb->next;
+    } else {
+        registry[bucket_of(wb->dev, wb->ino)] = wb->next;
+    }
+    if (wb->next != NULL) {
+        wb->next->prev = wb->prev;
+    }
+    --registry_count;
+    pthread_mutex_unlock(&registry_mutex);
+
+    /* A snapshot may still refer to the buffer, but it's empty from here on
+       so nobody touches the fd after the caller closes it. */
+    int res = write_behind_flush(wb);
+    release(wb);
+    return res;
+}
+
+int write_behind_flush_inode(dev_t dev, ino_t ino)
+{
+    int res = 0;
+
+    if (!anything_dirty()) {
+        return 0;
+    }
+
+    struct write_behind **snapshot;
+    size_t count;
+    res = take_snapshot(false, dev, ino, &snapshot, &count);
+    for (size_t i = 0; i < count; ++i) {
+        struct write_behind *wb = snapshot[i];
+        pthread_mutex_lock(&wb->mutex);
+        int r = flush_locked(wb);
+        if (r != 0 && wb->error == 0) {
+            wb->error = -r;  /* The handle's owner should hear about it too. */
+        }
+        pthread_mutex_unlock(&wb->mutex);
+        if (r != 0 && res == 0) {
+            res = r;
+        }
+    }
+    release_snapshot(snapshot, count);
+
+    return res;
+}
+
+off_t write_behind_pending_end(dev_t dev, ino_t ino)
+{
+    off_t end = -1;
+
+    if (!anything_dirty()) {
+        return -1;
+    }
+
+    struct write_behind **snapshot;
+    size_t count;
+    take_snapshot(false, dev, ino, &snapshot, &count);
+    for (size_t i = 0; i < count; ++i) {
+        struct write_behind *wb = snapshot[i];
+        pthread_mutex_lock(&wb->mutex);
+        if (wb->len > 0 && wb->offset + (off_t)wb->len > end) {
+            end = wb->offset + (off_t)wb->len;
+        }
+        pthread_mutex_unlock(&wb->mutex);
+    }
+    release_snapshot(snapshot, count);
+
+    return end;
+}
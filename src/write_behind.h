@@ -0,0 +1,59 @@
+/*
+    Copyright 2026 Martin Pärtel <martin.partel@gmail.com>
+
+    This file is part of bindfs.
+
+    bindfs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    bindfs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with bindfs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INC_BINDFS_WRITE_BEHIND_H
+#define INC_BINDFS_WRITE_BEHIND_H
+
+#include <sys/types.h>
+
+/* Buffers small writes to an open file so that they can be acknowledged
+ * before reaching the source filesystem.
+ *
+ * Each buffer holds one contiguous range. Writes that extend it are appended,
+ * and any other write first flushes it. Buffers are also flushed by a
+ * background thread shortly after they were last written to.
+ * Errors from background flushes are reported by the next write or flush. */
+struct write_behind;
+
+/* Starts the background flusher. Returns 0 or an error number. */
+int write_behind_start(unsigned int interval_ms);
+
+/* Stops the background flusher after flushing all buffers. */
+void write_behind_stop(void);
+
+/* Creates a buffer of `capacity` bytes for `fd`, which stays owned by the caller.
+ * Returns NULL on failure. */
+struct write_behind *write_behind_create(int fd, size_t capacity);
+
+/* Returns `size` or -errno. */
+ssize_t write_behind_write(struct write_behind *wb, const char *buf, size_t size, off_t offset);
+
+/* Writes out any buffered data. Returns 0 or -errno. */
+int write_behind_flush(struct write_behind *wb);
+
+/* Flushes and frees the buffer. Returns 0 or -errno. */
+int write_behind_close(struct write_behind *wb);
+
+/* Flushes all buffers of the given file. Returns 0 or -errno. */
+int write_behind_flush_inode(dev_t dev, ino_t ino);
+
+/* Returns the end offset of data buffered for the given file, or -1 if none. */
+off_t write_behind_pending_end(dev_t dev, ino_t ino);
+
+#endif
@@ -0,0 +1,157 @@
+#include "test_common.h"
+#include "accounting.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct row {
+    char key[16];
+    unsigned int pid;
+    unsigned long long ops;
+    double time_ms;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+};
+
+/* Prints the table and parses it back into `rows`. Returns the row count. */
+static int read_table(int by_pid, struct row *rows, int max_rows)
+{
+    FILE *f = tmpfile();
+    accounting_print(f, by_pid);
+    rewind(f);
+    char line[256];
+    int n = 0;
+    TEST_ASSERT(fgets(line, sizeof(line), f) != NULL);
+    TEST_ASSERT(strncmp(line, "uid", 3) == 0);
+    while (n < max_rows && fgets(line, sizeof(line), f) != NULL) {
+        struct row *r = &rows[n];
+        r->pid = 0;
+        int fields;
+        if (by_pid && strncmp(line, "other", 5) != 0) {
+            char pid[16];
+            fields = sscanf(line, "%15s %15s %llu %lf %llu %llu", r->key, pid,
+                            &r->ops, &r->time_ms, &r->bytes_read, &r->bytes_written) - 1;
+            r->pid = strcmp(pid, "other") == 0 ? ACCOUNTING_OTHER_PIDS : (unsigned int)atoi(pid);
+        } else {
+            fields = sscanf(line, "%15s %llu %lf %llu %llu", r->key,
+                            &r->ops, &r->time_ms, &r->bytes_read, &r->bytes_written);
+        }
+        TEST_ASSERT(fields == 5);
+        ++n;
+    }
+    fclose(f);
+    return n;
+}
+
+static void accounts_per_user(void)
+{
+    struct row rows[8];
+    TEST_ASSERT(accounting_init() == 0);
+
+    accounting_record_op(1000, 0, 0.002);
+    accounting_record_op(1000, 0, 0.001);
+    accounting_add_bytes(1000, 0, 4096, 0);
+    accounting_record_op(0, 0, 0.001);
+    accounting_add_bytes(0, 0, 0, 100);
+
+    int n = read_table(0, rows, 8);
+    TEST_ASSERT(n == 2);
+    TEST_ASSERT(strcmp(rows[0].key, "0") == 0);
+    TEST_ASSERT(rows[0].ops == 1 && rows[0].bytes_written == 100);
+    TEST_ASSERT(strcmp(rows[1].key, "1000") == 0);
+    TEST_ASSERT(rows[1].ops == 2 && rows[1].bytes_read == 4096 && rows[1].bytes_written == 0);
+    TEST_ASSERT(NEAR(3.0, rows[1].time_ms, 0.01));
+
+    accounting_free();
+}
+
+static void accounts_per_process(void)
+{
+    struct row rows[8];
+    TEST_ASSERT(accounting_init() == 0);
+
+    accounting_record_op(1000, 42, 0.001);
+    accounting_record_op(1000, 7, 0.001);
+    accounting_record_op(1000, 7, 0.001);
+
+    int n = read_table(1, rows, 8);
+    TEST_ASSERT(n == 2);
+    TEST_ASSERT(rows[0].pid == 7 && rows[0].ops == 2);
+    TEST_ASSERT(rows[1].pid == 42 && rows[1].ops == 1);
+
+    accounting_free();
+}
+
+static void overflows_when_full(void)
+{
+    static struct row rows[ACCOUNTING_SHARDS * ACCOUNTING_SHARD_SIZE + 1];
+    unsigned int keys = ACCOUNTING_SHARDS * ACCOUNTING_SHARD_SIZE * 2;
+    TEST_ASSERT(accounting_init() == 0);
+
+    for (unsigned int pid = 1; pid <= keys; ++pid) {
+        accounting_record_op(1000, pid, 0);
+    }
+    accounting_record_op(1001, 1, 0);
+
+    /* Processes that don't fit are still counted for their user. */
+    int n = read_table(1, rows, sizeof(rows) / sizeof(rows[0]));
+    TEST_ASSERT(n <= ACCOUNTING_SHARDS * ACCOUNTING_SHARD_SIZE);
+    unsigned long long total = 0;
+    unsigned long long other_pids = 0;
+    for (int i = 0; i < n; ++i) {
+        TEST_ASSERT(strcmp(rows[i].key, "other") != 0);
+        if (strcmp(rows[i].key, "1000") == 0) {
+            total += rows[i].ops;
+            if (rows[i].pid == ACCOUNTING_OTHER_PIDS) {
+                other_pids = rows[i].ops;
+            }
+        }
+    }
+    TEST_ASSERT(total == keys);
+    TEST_ASSERT(other_pids > 0);
+
+    accounting_free();
+}
+
+static void *recording_thread(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 10000; ++i) {
+        accounting_record_op(i % 10, 0, 0);
+        accounting_add_bytes(i % 10, 0, 1, 2);
+    }
+    return NULL;
+}
+
+static void counts_concurrent_updates(void)
+{
+    struct row rows[16];
+    pthread_t threads[4];
+    TEST_ASSERT(accounting_init() == 0);
+
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, recording_thread, NULL);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int n = read_table(0, rows, 16);
+    TEST_ASSERT(n == 10);
+    for (int i = 0; i < n; ++i) {
+        TEST_ASSERT(rows[i].ops == 4000);
+        TEST_ASSERT(rows[i].bytes_read == 4000 && rows[i].bytes_written == 8000);
+    }
+
+    accounting_free();
+}
+
+static void accounting_suite(void)
+{
+    accounts_per_user();
+    accounts_per_process();
+    overflows_when_full();
+    counts_concurrent_updates();
+}
+
+TEST_MAIN(accounting_suite)
@@ -0,0 +1,100 @@
+#include "test_common.h"
+#include "adaptive_limiter.h"
+
+static double time_now;
+
+static double test_clock(void)
+{
+    return time_now;
+}
+
+/* Records `count` operations of 1000 bytes, then one more after the window
+   has ended so that the limiter adjusts. */
+static void run_window(AdaptiveLimiter *al, int count, int slow_count)
+{
+    for (int i = 0; i < count; ++i) {
+        adaptive_limiter_record(al, i < slow_count ? 0.050 : 0.001, 1000);
+    }
+    time_now += 1.0;
+    adaptive_limiter_record(al, 0.001, 1000);
+}
+
+void does_not_limit_while_latency_is_low(void)
+{
+    time_now = 1000.0;
+    AdaptiveLimiter *al = adaptive_limiter_create(0.010, 1000, &test_clock);
+
+    run_window(al, 100, 0);
+    TEST_ASSERT(adaptive_limiter_rate(al) == 0);
+    TEST_ASSERT(adaptive_limiter_wait_nosleep(al, 1000000) == 0);
+
+    adaptive_limiter_destroy(al);
+}
+
+void halves_throughput_when_p99_is_over_target(void)
+{
+    time_now = 1000.0;
+    AdaptiveLimiter *al = adaptive_limiter_create(0.010, 1000, &test_clock);
+
+    run_window(al, 100, 10);
+    TEST_ASSERT(NEAR(50500, adaptive_limiter_rate(al), 0.001));
+    TEST_ASSERT(adaptive_limiter_wait_nosleep(al, 101000) > 1.0);
+
+    adaptive_limiter_destroy(al);
+}
+
+void ignores_a_few_slow_operations(void)
+{
+    time_now = 1000.0;
+    AdaptiveLimiter *al = adaptive_limiter_create(0.010, 1000, &test_clock);
+
+    /* Under 1% */
+    run_window(al, 200, 1);
+    TEST_ASSERT(adaptive_limiter_rate(al) == 0);
+    /* Too few samples to tell */
+    run_window(al, 5, 5);
+    TEST_ASSERT(adaptive_limiter_rate(al) == 0);
+
+    adaptive_limiter_destroy(al);
+}
+
+void recovers_when_latency_drops(void)
+{
+    time_now = 1000.0;
+    AdaptiveLimiter *al = adaptive_limiter_create(0.010, 1000, &test_clock);
+
+    run_window(al, 100, 10);
+    TEST_ASSERT(NEAR(50500, adaptive_limiter_rate(al), 0.001));
+
+    /* Grows by a tenth of the cut rate per window. */
+    run_window(al, 50, 0);
+    TEST_ASSERT(NEAR(55550, adaptive_limiter_rate(al), 0.001));
+
+    /* Stops limiting once the limit is far above the throughput. */
+    run_window(al, 20, 0);
+    TEST_ASSERT(adaptive_limiter_rate(al) == 0);
+
+    adaptive_limiter_destroy(al);
+}
+
+void does_not_go_below_min_rate(void)
+{
+    time_now = 1000.0;
+    AdaptiveLimiter *al = adaptive_limiter_create(0.010, 100000, &test_clock);
+
+    run_window(al, 100, 100);
+    TEST_ASSERT(NEAR(100000, adaptive_limiter_rate(al), 0.001));
+
+    adaptive_limiter_destroy(al);
+}
+
+void adaptive_limiter_suite(void)
+{
+    does_not_limit_while_latency_is_low();
+    halves_throughput_when_p99_is_over_target();
+    ignores_a_few_slow_operations();
+    recovers_when_latency_drops();
+    does_not_go_below_min_rate();
+}
+
+TEST_MAIN(adaptive_limiter_suite)
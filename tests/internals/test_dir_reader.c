@@ -0,0 +1,173 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "dir_reader.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NUM_FILES 3000
+
+static char dir_path[] = "/tmp/bindfs_test_dir_reader_XXXXXX";
+
+static void create_files(void)
+{
+    char name[64];
+    for (int i = 0; i < NUM_FILES; ++i) {
+        snprintf(name, sizeof(name), "%s/file_%d", dir_path, i);
+        int fd = open(name, O_CREAT | O_WRONLY, 0644);
+        TEST_ASSERT(fd != -1);
+        close(fd);
+    }
+}
+
+static void delete_files(void)
+{
+    char name[64];
+    for (int i = 0; i < NUM_FILES; ++i) {
+        snprintf(name, sizeof(name), "%s/file_%d", dir_path, i);
+        unlink(name);
+    }
+    rmdir(dir_path);
+}
+
+static struct dir_reader *open_reader(void)
+{
+    int fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    TEST_ASSERT(fd != -1);
+    struct dir_reader *dr = dir_reader_open(fd);
+    TEST_ASSERT(dr != NULL);
+    return dr;
+}
+
+/* Reads up to `max` entries, marking seen files. Returns the number read. */
+static int read_entries(struct dir_reader *dr, int max, bool *seen)
+{
+    int count = 0;
+    struct dir_reader_entry de;
+    while (count < max && dir_reader_peek(dr, &de) == 1) {
+        int i;
+        if (sscanf(de.name, "file_%d", &i) == 1 && i >= 0 && i < NUM_FILES) {
+            TEST_ASSERT(!seen[i]);
+            seen[i] = true;
+        }
+        dir_reader_next(dr);
+        ++count;
+    }
+    return count;
+}
+
+static int count_seen(bool *seen)
+{
+    int count = 0;
+    for (int i = 0; i < NUM_FILES; ++i) {
+        if (seen[i]) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+static void reads_all_entries(void)
+{
+    bool seen[NUM_FILES] = { false };
+    struct dir_reader *dr = open_reader();
+
+    int count = read_entries(dr, NUM_FILES * 2, seen);
+    TEST_ASSERT(count == NUM_FILES + 2);  /* '.' and '..' */
+    TEST_ASSERT(count_seen(seen) == NUM_FILES);
+
+    struct dir_reader_entry de;
+    TEST_ASSERT(dir_reader_peek(dr, &de) == 0);
+
+    dir_reader_close(dr);
+}
+
+static void peek_does_not_advance(void)
+{
+    struct dir_reader *dr = open_reader();
+
+    struct dir_reader_entry de;
+    TEST_ASSERT(dir_reader_peek(dr, &de) == 1);
+    char *first = strdup(de.name);
+    TEST_ASSERT(dir_reader_peek(dr, &de) == 1);
+    TEST_ASSERT(strcmp(first, de.name) == 0);
+    dir_reader_next(dr);
+    TEST_ASSERT(dir_reader_peek(dr, &de) == 1);
+    TEST_ASSERT(strcmp(first, de.name) != 0);
+
+    free(first);
+    dir_reader_close(dr);
+}
+
+static void continues_from_offsets(void)
+{
+    bool seen[NUM_FILES] = { false };
+    struct dir_reader *dr = open_reader();
+
+    int count = read_entries(dr, 1000, seen);
+    off_t offset = dir_reader_tell(dr);
+
+    /* Rewind and read a bit to move the underlying fd elsewhere. */
+    bool ignored[NUM_FILES] = { false };
+    dir_reader_seek(dr, 0);
+    read_entries(dr, 10, ignored);
+
+    dir_reader_seek(dr, offset);
+    count += read_entries(dr, NUM_FILES * 2, seen);
+    TEST_ASSERT(count == NUM_FILES + 2);
+    TEST_ASSERT(count_seen(seen) == NUM_FILES);
+
+    dir_reader_close(dr);
+}
+
+static void interleaved_readers(void)
+{
+    bool seen1[NUM_FILES] = { false };
+    bool seen2[NUM_FILES] = { false };
+    struct dir_reader *dr1 = open_reader();
+    struct dir_reader *dr2 = open_reader();
+
+    int count1 = 0;
+    int count2 = 0;
+    while (1) {
+        int got1 = read_entries(dr1, 7, seen1);
+        int got2 = read_entries(dr2, 13, seen2);
+        count1 += got1;
+        count2 += got2;
+        if (got1 == 0 && got2 == 0) {
+            break;
+        }
+    }
+    TEST_ASSERT(count1 == NUM_FILES + 2);
+    TEST_ASSERT(count2 == NUM_FILES + 2);
+    TEST_ASSERT(count_seen(seen1) == NUM_FILES);
+    TEST_ASSERT(count_seen(seen2) == NUM_FILES);
+
+    dir_reader_close(dr1);
+    dir_reader_close(dr2);
+}
+
+static void dir_reader_suite(void)
+{
+    if (mkdtemp(dir_path) == NULL) {
+        perror("mkdtemp");
+        ++failures;
+        return;
+    }
+    create_files();
+
+    reads_all_entries();
+    peek_does_not_advance();
+    continues_from_offsets();
+    interleaved_readers();
+
+    delete_files();
+}
+
+TEST_MAIN(dir_reader_suite)
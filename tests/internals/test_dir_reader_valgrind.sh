@@ -0,0 +1,11 @@
+#!/bin/sh -eu
+if [ ! -x ./test_dir_reader ]; then
+    cd `dirname "$0"`
+fi
+
+if [ -n "`which valgrind`" ]; then
+    valgrind --error-exitcode=100 ./test_dir_reader
+else
+    echo "Warning: valgrind not found. Running without."
+    ./test_dir_reader
+fi
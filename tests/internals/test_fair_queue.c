@@ -0,0 +1,106 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "fair_queue.h"
+#include <pthread.h>
+
+#define REQUESTS_PER_THREAD 6
+#define MAX_DISPATCHES 64
+
+static FairQueue *queue;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int dispatch_log[MAX_DISPATCHES];
+static int num_dispatches;
+
+static void *requesting_thread(void *arg)
+{
+    unsigned int key = *(unsigned int *)arg;
+    for (int i = 0; i < REQUESTS_PER_THREAD; ++i) {
+        fair_queue_wait(queue, key, 20);
+        pthread_mutex_lock(&log_mutex);
+        dispatch_log[num_dispatches++] = key;
+        pthread_mutex_unlock(&log_mutex);
+    }
+    return NULL;
+}
+
+/* Runs one thread per entry of `keys` and returns the position in the
+ * dispatch log after which `key` had no more requests. */
+static int run(unsigned int *keys, int num_threads, unsigned int key)
+{
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 1000, &monotonic_clock);
+    /* Use up the idle credit so that the first threads can't get ahead
+       before the others have started. */
+    rate_limiter_wait_nosleep(&limiter, 200);
+    queue = fair_queue_create(&limiter);
+    fair_queue_set_weight(queue, 3, 3.0);
+    num_dispatches = 0;
+
+    pthread_t threads[8];
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_create(&threads[i], NULL, &requesting_thread, &keys[i]);
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int last = -1;
+    for (int i = 0; i < num_dispatches; ++i) {
+        if (dispatch_log[i] == key) {
+            last = i;
+        }
+    }
+
+    fair_queue_destroy(queue);
+    rate_limiter_destroy(&limiter);
+    return last;
+}
+
+static void shares_equally_between_flows(void)
+{
+    /* Flow 1 has four threads, flow 2 has one. Without fair queuing,
+       flow 2 would get about a fifth of the dispatches. */
+    unsigned int keys[] = { 1, 1, 1, 1, 2 };
+    int last = run(keys, 5, 2);
+    TEST_ASSERT(num_dispatches == 5 * REQUESTS_PER_THREAD);
+    TEST_ASSERT(last < 3 * REQUESTS_PER_THREAD);
+}
+
+static void respects_weights(void)
+{
+    /* Flow 3 has weight 3, so it should be done when flow 1 has had about
+       a third as many dispatches. */
+    unsigned int keys[] = { 1, 1, 3 };
+    int last = run(keys, 3, 3);
+    TEST_ASSERT(num_dispatches == 3 * REQUESTS_PER_THREAD);
+    TEST_ASSERT(last < REQUESTS_PER_THREAD + REQUESTS_PER_THREAD / 2 + 2);
+}
+
+static void forgets_idle_flows(void)
+{
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 1e12, &monotonic_clock);
+    queue = fair_queue_create(&limiter);
+    TEST_ASSERT(queue != NULL);
+    TEST_ASSERT(fair_queue_set_weight(queue, 3, 3.0) == 0);
+
+    /* Many short-lived flows, e.g. one per process. */
+    for (unsigned int key = 100; key < 10000; ++key) {
+        fair_queue_wait(queue, key, 1);
+    }
+    TEST_ASSERT(fair_queue_set_weight(queue, 3, 2.0) == 0);
+    fair_queue_wait(queue, 3, 1);
+
+    fair_queue_destroy(queue);
+    rate_limiter_destroy(&limiter);
+}
+
+static void fair_queue_suite(void)
+{
+    shares_equally_between_flows();
+    respects_weights();
+    forgets_idle_flows();
+}
+
+TEST_MAIN(fair_queue_suite)
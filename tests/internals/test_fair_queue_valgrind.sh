@@ -0,0 +1,11 @@
+#!/bin/sh -eu
+if [ ! -x ./test_fair_queue ]; then
+    cd `dirname "$0"`
+fi
+
+if [ -n "`which valgrind`" ]; then
+    valgrind --error-exitcode=100 ./test_fair_queue
+else
+    echo "Warning: valgrind not found. Running without."
+    ./test_fair_queue
+fi
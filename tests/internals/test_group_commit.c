@@ -0,0 +1,66 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "group_commit.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NUM_THREADS 8
+#define SYNCS_PER_THREAD 5
+
+static char file_path[] = "/tmp/bindfs_test_group_commit_XXXXXX";
+static int file_fd;
+
+static void *syncing_thread(void *arg)
+{
+    int *errors = arg;
+    for (int i = 0; i < SYNCS_PER_THREAD; ++i) {
+        if (group_commit_sync(file_fd) != 0) {
+            ++*errors;
+        }
+    }
+    return NULL;
+}
+
+static void syncs_without_committer(void)
+{
+    TEST_ASSERT(group_commit_sync(file_fd) == 0);
+    TEST_ASSERT(group_commit_sync(-1) == -EBADF);
+}
+
+static void batches_concurrent_syncs(void)
+{
+    pthread_t threads[NUM_THREADS];
+    int errors[NUM_THREADS] = {0};
+
+    TEST_ASSERT(group_commit_start(5) == 0);
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        TEST_ASSERT(pthread_create(&threads[i], NULL, &syncing_thread, &errors[i]) == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        TEST_ASSERT(errors[i] == 0);
+    }
+    TEST_ASSERT(group_commit_sync(-1) == -EBADF);
+    group_commit_stop();
+
+    /* Still works after stopping. */
+    TEST_ASSERT(group_commit_sync(file_fd) == 0);
+}
+
+static void group_commit_suite(void)
+{
+    file_fd = mkstemp(file_path);
+    TEST_ASSERT(file_fd != -1);
+    TEST_ASSERT(write(file_fd, "abc", 3) == 3);
+
+    syncs_without_committer();
+    batches_concurrent_syncs();
+
+    close(file_fd);
+    unlink(file_path);
+}
+
+TEST_MAIN(group_commit_suite)
@@ -0,0 +1,186 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+static char name[32];
+
+static void validates_names(void)
+{
+    TEST_ASSERT(metrics_valid_name("disk-1"));
+    TEST_ASSERT(!metrics_valid_name(""));
+    TEST_ASSERT(!metrics_valid_name("a/b"));
+    TEST_ASSERT(!metrics_valid_name("a_name_that_is_too_long"));
+    TEST_ASSERT(metrics_open("a/b") == -1 && errno == EINVAL);
+}
+
+static void does_nothing_when_closed(void)
+{
+    TEST_ASSERT(metrics_register_op("getattr") == -1);
+    metrics_count_op(0, 0);
+    metrics_add(METRIC_BYTES_READ, 100);
+    TEST_ASSERT(metrics_attach(name) == NULL && errno == ENOENT);
+}
+
+static void publishes_counters(void)
+{
+    TEST_ASSERT(metrics_open(name) == 0);
+    int getattr = metrics_register_op("getattr");
+    int read = metrics_register_op("read");
+    TEST_ASSERT(getattr == 0 && read == 1);
+
+    const struct metrics_segment *seg = metrics_attach(name);
+    TEST_ASSERT(seg != NULL);
+    if (seg == NULL) {
+        metrics_close();
+        return;
+    }
+    TEST_ASSERT(seg->pid == getpid());
+    TEST_ASSERT(seg->num_ops == 2);
+    TEST_ASSERT(strcmp(seg->op_names[read], "read") == 0);
+
+    metrics_count_op(getattr, 0);
+    metrics_count_op(getattr, 1);
+    metrics_count_op(read, 0);
+    metrics_count_op(-1, 0);
+    metrics_add(METRIC_BYTES_READ, 4096);
+    metrics_add(METRIC_BYTES_READ, 10);
+    metrics_add(METRIC_USER_CACHE_REBUILDS, 1);
+    TEST_ASSERT(seg->op_counts[getattr] == 2 && seg->op_errors[getattr] == 1);
+    TEST_ASSERT(seg->op_counts[read] == 1 && seg->op_errors[read] == 0);
+    TEST_ASSERT(seg->values[METRIC_BYTES_READ] == 4106);
+    TEST_ASSERT(seg->values[METRIC_BYTES_WRITTEN] == 0);
+    TEST_ASSERT(seg->values[METRIC_USER_CACHE_REBUILDS] == 1);
+
+    metrics_set_pid(12345);
+    TEST_ASSERT(seg->pid == 12345);
+
+    /* Closing removes the segment but a reader keeps its mapping. */
+    metrics_close();
+    TEST_ASSERT(metrics_attach(name) == NULL && errno == ENOENT);
+    TEST_ASSERT(seg->op_counts[getattr] == 2);
+    metrics_detach(seg);
+}
+
+/* Creates a segment as if by a bindfs with the given pid. */
+static void fake_segment(int64_t pid)
+{
+    struct metrics_segment copy;
+    TEST_ASSERT(metrics_open(name) == 0);
+    const struct metrics_segment *seg = metrics_attach(name);
+    TEST_ASSERT(seg != NULL);
+    memcpy(&copy, seg, sizeof(copy));
+    metrics_detach(seg);
+    metrics_close();
+
+    copy.pid = pid;
+    char path[64];
+    snprintf(path, sizeof(path), "/bindfs-stat-%s", name);
+    int fd = shm_open(path, O_RDWR | O_CREAT, 0600);
+    TEST_ASSERT(fd != -1);
+    TEST_ASSERT(write(fd, &copy, sizeof(copy)) == (ssize_t)sizeof(copy));
+    close(fd);
+}
+
+static void replaces_old_segment(void)
+{
+    /* As if left behind by a bindfs that crashed while starting. */
+    char path[64];
+    snprintf(path, sizeof(path), "/bindfs-stat-%s", name);
+    int fd = shm_open(path, O_RDWR | O_CREAT, 0600);
+    TEST_ASSERT(fd != -1);
+    TEST_ASSERT(ftruncate(fd, 16) == 0);
+    close(fd);
+    TEST_ASSERT(metrics_attach(name) == NULL && errno == EPROTO);
+
+    TEST_ASSERT(metrics_open(name) == 0);
+    TEST_ASSERT(metrics_open(name) == -1 && errno == EBUSY);
+    const struct metrics_segment *seg = metrics_attach(name);
+    TEST_ASSERT(seg != NULL);
+    if (seg) {
+        TEST_ASSERT(seg->values[METRIC_BYTES_WRITTEN] == 0);
+        metrics_detach(seg);
+    }
+    metrics_close();
+
+    /* As if left behind by a bindfs that crashed later. */
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(0);
+    }
+    TEST_ASSERT(child > 0);
+    waitpid(child, NULL, 0);
+    fake_segment(child);
+    TEST_ASSERT(metrics_open(name) == 0);
+    metrics_close();
+}
+
+static void refuses_segment_in_use(void)
+{
+    /* Our own pid stands in for another running bindfs. */
+    fake_segment(getpid());
+    TEST_ASSERT(metrics_open(name) == -1 && errno == EADDRINUSE);
+    const struct metrics_segment *seg = metrics_attach(name);
+    TEST_ASSERT(seg != NULL);
+    if (seg) {
+        TEST_ASSERT(seg->pid == getpid());
+        metrics_detach(seg);
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/bindfs-stat-%s", name);
+    shm_unlink(path);
+}
+
+static void waits_for_segment_being_created(void)
+{
+    /* Another bindfs has created its segment but not yet filled it in. */
+    fake_segment(getpid());
+    char path[64];
+    snprintf(path, sizeof(path), "/bindfs-stat-%s", name);
+    struct metrics_segment copy;
+    int fd = shm_open(path, O_RDWR, 0600);
+    TEST_ASSERT(fd != -1);
+    TEST_ASSERT(read(fd, &copy, sizeof(copy)) == (ssize_t)sizeof(copy));
+    TEST_ASSERT(ftruncate(fd, 16) == 0);
+
+    pid_t child = fork();
+    if (child == 0) {
+        struct timespec ts = { 0, 100 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+        if (pwrite(fd, &copy, sizeof(copy), 0) != (ssize_t)sizeof(copy)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    TEST_ASSERT(child > 0);
+    close(fd);
+
+    TEST_ASSERT(metrics_open(name) == -1 && errno == EADDRINUSE);
+    int status;
+    waitpid(child, &status, 0);
+    TEST_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    shm_unlink(path);
+}
+
+static void metrics_suite(void)
+{
+    snprintf(name, sizeof(name), "test-%d", (int)getpid());
+
+    validates_names();
+    does_nothing_when_closed();
+    publishes_counters();
+    replaces_old_segment();
+    refuses_segment_in_use();
+    waits_for_segment_being_created();
+}
+
+TEST_MAIN(metrics_suite)
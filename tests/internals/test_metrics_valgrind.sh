@@ -0,0 +1,11 @@
+#!/bin/sh -eu
+if [ ! -x ./test_metrics ]; then
+    cd `dirname "$0"`
+fi
+
+if [ -n "`which valgrind`" ]; then
+    valgrind --error-exitcode=100 ./test_metrics
+else
+    echo "Warning: valgrind not found. Running without."
+    ./test_metrics
+fi
@@ -1,6 +1,8 @@
 
 #include "test_common.h"
 #include "rate_limiter.h"
+#include "rate_limiter_table.h"
+#include <pthread.h>
 
 static const double epsilon = 0.000000000001;
 
@@ -58,11 +60,146 @@ void sleeps_correct_amount(void)
     rate_limiter_destroy(&limiter);
 }
 
+#define NUM_THREADS 8
+#define WAITS_PER_THREAD 10000
+
+static void *waiting_thread(void *arg)
+{
+    RateLimiter *limiter = arg;
+    for (int i = 0; i < WAITS_PER_THREAD; ++i) {
+        rate_limiter_wait_nosleep(limiter, 1);
+    }
+    return NULL;
+}
+
+void counts_every_concurrent_wait(void)
+{
+    time_now = 123123.0;
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 1000, &test_clock);
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_create(&threads[i], NULL, &waiting_thread, &limiter);
+    }
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    double sleep_time = rate_limiter_wait_nosleep(&limiter, 0);
+    double expected = NUM_THREADS * WAITS_PER_THREAD / 1000.0 + rate_limiter_idle_credit;
+    TEST_ASSERT(NEAR(expected, sleep_time, 0.000001));
+
+    rate_limiter_destroy(&limiter);
+}
+
+void sleeps_on_monotonic_clock(void)
+{
+    double t1 = monotonic_clock();
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 10, &monotonic_clock);
+    rate_limiter_wait(&limiter, 3);
+    double t2 = monotonic_clock();
+    TEST_ASSERT(t2 >= t1 + 0.05);
+    rate_limiter_destroy(&limiter);
+}
+
+void table_keeps_keys_separate(void)
+{
+    time_now = 123123.0;
+    RateLimiterTable *table = rate_limiter_table_create(10, &test_clock);
+
+    double sleep_time = rate_limiter_table_wait_nosleep(table, 1000, 30);
+    TEST_ASSERT(NEAR(3.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+    sleep_time = rate_limiter_table_wait_nosleep(table, 1001, 20);
+    TEST_ASSERT(NEAR(2.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+    sleep_time = rate_limiter_table_wait_nosleep(table, 1000, 20);
+    TEST_ASSERT(NEAR(5.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+    TEST_ASSERT(rate_limiter_table_size(table) == 2);
+
+    rate_limiter_table_destroy(table);
+}
+
+void table_reclaims_idle_limiters(void)
+{
+    time_now = 123123.0;
+    RateLimiterTable *table = rate_limiter_table_create(10, &test_clock);
+
+    rate_limiter_table_wait_nosleep(table, 1, 10);
+    rate_limiter_table_wait_nosleep(table, 2, 100);
+    TEST_ASSERT(rate_limiter_table_size(table) == 2);
+
+    /* Key 1 has caught up, key 2 is still in debt. */
+    time_now += 2;
+    rate_limiter_table_wait_nosleep(table, 3, 10);
+    TEST_ASSERT(rate_limiter_table_size(table) == 2);
+
+    /* A reclaimed key starts from scratch. */
+    double sleep_time = rate_limiter_table_wait_nosleep(table, 1, 30);
+    TEST_ASSERT(NEAR(3.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+    TEST_ASSERT(rate_limiter_table_size(table) == 3);
+
+    rate_limiter_table_destroy(table);
+}
+
+void applies_new_rate_to_later_waits(void)
+{
+    time_now = 123123.0;
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 10, &test_clock);
+
+    double sleep_time = rate_limiter_wait_nosleep(&limiter, 30);
+    TEST_ASSERT(NEAR(3.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+    rate_limiter_set_rate(&limiter, 20);
+    sleep_time = rate_limiter_wait_nosleep(&limiter, 20);
+    TEST_ASSERT(NEAR(4.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+
+    rate_limiter_destroy(&limiter);
+}
+
+void applies_new_idle_credit(void)
+{
+    time_now = 123123.0;
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 10, &test_clock);
+
+    rate_limiter_set_idle_credit(-1.0);
+    time_now += 100;
+    TEST_ASSERT(rate_limiter_idle(&limiter));
+    double sleep_time = rate_limiter_wait_nosleep(&limiter, 30);
+    TEST_ASSERT(NEAR(2.0, sleep_time, epsilon));
+
+    rate_limiter_set_idle_credit(rate_limiter_idle_credit);
+    rate_limiter_destroy(&limiter);
+}
+
+void table_applies_new_rate_to_all_keys(void)
+{
+    time_now = 123123.0;
+    RateLimiterTable *table = rate_limiter_table_create(10, &test_clock);
+
+    rate_limiter_table_wait_nosleep(table, 1, 10);
+    rate_limiter_table_set_rate(table, 5);
+    double sleep_time = rate_limiter_table_wait_nosleep(table, 1, 10);
+    TEST_ASSERT(NEAR(3.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+    sleep_time = rate_limiter_table_wait_nosleep(table, 2, 10);
+    TEST_ASSERT(NEAR(2.0 + rate_limiter_idle_credit, sleep_time, epsilon));
+
+    rate_limiter_table_destroy(table);
+}
+
 void rate_limiter_suite(void)
 {
     computes_correct_sleep_times();
     works_after_being_idle();
     sleeps_correct_amount();
+    counts_every_concurrent_wait();
+    sleeps_on_monotonic_clock();
+    table_keeps_keys_separate();
+    table_reclaims_idle_limiters();
+    applies_new_rate_to_later_waits();
+    applies_new_idle_credit();
+    table_applies_new_rate_to_all_keys();
 }
 
 TEST_MAIN(rate_limiter_suite)
@@ -0,0 +1,88 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "readahead.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const size_t chunk = 4096;
+static const size_t max_window = 64 * 1024;
+
+static char file_path[] = "/tmp/bindfs_test_readahead_XXXXXX";
+
+static void hints_ahead_of_sequential_reads(int fd)
+{
+    struct readahead_state ra;
+    readahead_init(&ra, max_window);
+
+    TEST_ASSERT(readahead_note_read(&ra, fd, 0, chunk) == READAHEAD_NONE);
+    TEST_ASSERT(readahead_note_read(&ra, fd, chunk, chunk) == READAHEAD_NONE);
+    TEST_ASSERT(readahead_note_read(&ra, fd, 2 * chunk, chunk) == READAHEAD_WILLNEED);
+    TEST_ASSERT(ra.window == 4 * chunk);
+    TEST_ASSERT(ra.hinted_end == (off_t)(7 * chunk));
+
+    /* The window grows up to the maximum. */
+    for (off_t offset = 3 * chunk; offset < (off_t)(64 * chunk); offset += chunk) {
+        readahead_note_read(&ra, fd, offset, chunk);
+        TEST_ASSERT(ra.window <= max_window);
+        TEST_ASSERT(ra.hinted_end > offset + (off_t)chunk);
+    }
+    TEST_ASSERT(ra.window == max_window);
+    TEST_ASSERT(!ra.random_mode);
+
+    readahead_destroy(&ra);
+}
+
+static void does_not_hint_on_every_read(int fd)
+{
+    struct readahead_state ra;
+    readahead_init(&ra, max_window);
+
+    int hints = 0;
+    for (off_t offset = 0; offset < (off_t)(256 * chunk); offset += chunk) {
+        if (readahead_note_read(&ra, fd, offset, chunk) == READAHEAD_WILLNEED) {
+            ++hints;
+        }
+    }
+    TEST_ASSERT(hints > 0);
+    TEST_ASSERT(hints < 256 / 4);
+
+    readahead_destroy(&ra);
+}
+
+static void switches_between_random_and_sequential(int fd)
+{
+    struct readahead_state ra;
+    readahead_init(&ra, max_window);
+
+    off_t offsets[] = { 10 * chunk, 3 * chunk, 50 * chunk, 7 * chunk };
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT(readahead_note_read(&ra, fd, offsets[i], chunk) == READAHEAD_NONE);
+    }
+    TEST_ASSERT(readahead_note_read(&ra, fd, offsets[3], chunk) == READAHEAD_RANDOM);
+    TEST_ASSERT(ra.random_mode);
+    TEST_ASSERT(readahead_note_read(&ra, fd, 0, chunk) == READAHEAD_NONE);
+
+    TEST_ASSERT(readahead_note_read(&ra, fd, chunk, chunk) == READAHEAD_NONE);
+    TEST_ASSERT(readahead_note_read(&ra, fd, 2 * chunk, chunk) == READAHEAD_WILLNEED);
+    TEST_ASSERT(!ra.random_mode);
+
+    readahead_destroy(&ra);
+}
+
+static void readahead_suite(void)
+{
+    int fd = mkstemp(file_path);
+    TEST_ASSERT(fd != -1);
+    TEST_ASSERT(ftruncate(fd, 1024 * 1024) == 0);
+
+    hints_ahead_of_sequential_reads(fd);
+    does_not_hint_on_every_read(fd);
+    switches_between_random_and_sequential(fd);
+
+    close(fd);
+    unlink(file_path);
+}
+
+TEST_MAIN(readahead_suite)
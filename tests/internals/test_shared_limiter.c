@@ -0,0 +1,60 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "rate_limiter.h"
+#include "shared_limiter.h"
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static char name[32];
+
+static void validates_names(void)
+{
+    TEST_ASSERT(shared_limiter_valid_name("disk-1"));
+    TEST_ASSERT(!shared_limiter_valid_name(""));
+    TEST_ASSERT(!shared_limiter_valid_name("a/b"));
+    TEST_ASSERT(!shared_limiter_valid_name("a_name_that_is_far_too_long"));
+    TEST_ASSERT(shared_limiter_open("a/b") == NULL && errno == EINVAL);
+}
+
+static void shares_bucket_between_handles(void)
+{
+    SharedLimiter *a = shared_limiter_open(name);
+    SharedLimiter *b = shared_limiter_open(name);
+    TEST_ASSERT(a != NULL && b != NULL);
+
+    double t1 = shared_limiter_wait_nosleep(a, SHARED_BUCKET_READ, 1000, 300);
+    TEST_ASSERT(NEAR(0.3 + rate_limiter_idle_credit, t1, 0.05));
+    double t2 = shared_limiter_wait_nosleep(b, SHARED_BUCKET_READ, 1000, 300);
+    TEST_ASSERT(NEAR(0.6 + rate_limiter_idle_credit, t2, 0.05));
+
+    /* The write bucket is separate. */
+    double t3 = shared_limiter_wait_nosleep(b, SHARED_BUCKET_WRITE, 1000, 300);
+    TEST_ASSERT(NEAR(0.3 + rate_limiter_idle_credit, t3, 0.05));
+
+    shared_limiter_close(a);
+    shared_limiter_close(b);
+}
+
+static void keeps_state_while_removed(void)
+{
+    SharedLimiter *a = shared_limiter_open(name);
+    TEST_ASSERT(a != NULL);
+    TEST_ASSERT(shared_limiter_remove(name) == 0);
+    double t = shared_limiter_wait_nosleep(a, SHARED_BUCKET_READ, 1000, 100);
+    TEST_ASSERT(NEAR(0.7 + rate_limiter_idle_credit, t, 0.05));  /* Continues from above */
+    shared_limiter_close(a);
+}
+
+static void shared_limiter_suite(void)
+{
+    snprintf(name, sizeof(name), "test-%d", (int)getpid());
+    shared_limiter_remove(name);
+
+    validates_names();
+    shares_bucket_between_handles();
+    keeps_state_while_removed();
+}
+
+TEST_MAIN(shared_limiter_suite)
@@ -0,0 +1,101 @@
+#include "test_common.h"
+#include "histogram.h"
+#include "stats.h"
+#include <pthread.h>
+#include <string.h>
+
+void histogram_buckets_are_ordered(void)
+{
+    TEST_ASSERT(histogram_bucket(0) == 0);
+    TEST_ASSERT(histogram_bucket(0.000003) == 3);
+    TEST_ASSERT(histogram_bucket(0.000004) == 4);
+    TEST_ASSERT(histogram_bucket(1e9) == HISTOGRAM_BUCKETS - 1);
+    for (double t = 0.000001; t < 1000; t *= 1.1) {
+        int b = histogram_bucket(t);
+        TEST_ASSERT(t <= histogram_bucket_upper_bound(b));
+        TEST_ASSERT(b < 4 || t <= 1.25 * histogram_bucket_upper_bound(b - 1));
+    }
+}
+
+void histogram_finds_percentiles(void)
+{
+    unsigned long long counts[HISTOGRAM_BUCKETS] = { 0 };
+    counts[histogram_bucket(0.001)] = 99;
+    counts[histogram_bucket(0.100)] = 1;
+    TEST_ASSERT(NEAR(0.001, histogram_percentile(counts, 100, 0.50), 0.0003));
+    TEST_ASSERT(NEAR(0.001, histogram_percentile(counts, 100, 0.99), 0.0003));
+    TEST_ASSERT(NEAR(0.100, histogram_percentile(counts, 100, 1.0), 0.03));
+    TEST_ASSERT(histogram_percentile(counts, 0, 0.5) == 0);
+}
+
+static int op_read;
+static int op_write;
+
+static void *recording_thread(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 100; ++i) {
+        stats_record(op_read, 0.001, 0);
+    }
+    stats_record(op_write, 0.002, 1);
+    return NULL;
+}
+
+/* Finds the line of `op` in the output of stats_print. */
+static int read_line(FILE *f, const char *op, unsigned long long *count,
+                     unsigned long long *errors, double *p50_us)
+{
+    char line[256];
+    char name[64];
+    double mean_us;
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%63s %llu %llu %lf %lf", name, count, errors, &mean_us, p50_us) == 5 &&
+            strcmp(name, op) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void sums_shards_of_all_threads(void)
+{
+    op_read = stats_register_op("read");
+    op_write = stats_register_op("write");
+    stats_register_op("unused");
+
+    /* Some threads exit before the stats are printed, one is still alive. */
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, &recording_thread, NULL);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    recording_thread(NULL);
+
+    FILE *f = tmpfile();
+    stats_print(f);
+
+    unsigned long long count = 0, errors = 0;
+    double p50_us = 0;
+    TEST_ASSERT(read_line(f, "read", &count, &errors, &p50_us));
+    TEST_ASSERT(count == 500);
+    TEST_ASSERT(errors == 0);
+    TEST_ASSERT(NEAR(1000, p50_us, 300));
+    TEST_ASSERT(read_line(f, "write", &count, &errors, &p50_us));
+    TEST_ASSERT(count == 5);
+    TEST_ASSERT(errors == 5);
+    TEST_ASSERT(!read_line(f, "unused", &count, &errors, &p50_us));
+
+    fclose(f);
+}
+
+void stats_suite(void)
+{
+    histogram_buckets_are_ordered();
+    histogram_finds_percentiles();
+    sums_shards_of_all_threads();
+}
+
+TEST_MAIN(stats_suite)
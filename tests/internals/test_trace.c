@@ -0,0 +1,153 @@
+#include "test_common.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int op_getattr;
+static int op_read;
+
+/* Reads back the events written to `f` after the header. */
+static size_t read_events(FILE *f, struct trace_event *events, size_t max_events)
+{
+    struct trace_header header;
+    char names[TRACE_MAX_OPS][TRACE_OP_NAME_LEN];
+    rewind(f);
+    TEST_ASSERT(fread(&header, sizeof(header), 1, f) == 1);
+    TEST_ASSERT(memcmp(header.magic, TRACE_MAGIC, 8) == 0);
+    TEST_ASSERT(header.version == TRACE_VERSION);
+    TEST_ASSERT(header.num_ops == 2);
+    TEST_ASSERT(fread(names, TRACE_OP_NAME_LEN, header.num_ops, f) == header.num_ops);
+    TEST_ASSERT(strcmp(names[op_read], "read") == 0);
+    return fread(events, sizeof(struct trace_event), max_events, f);
+}
+
+static void *tracing_thread(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 100; ++i) {
+        trace_enter(op_getattr, "/dir/file");
+        trace_exit(op_getattr, i % 2 == 0 ? 0 : -2);
+    }
+    return NULL;
+}
+
+static void traces_threads(void)
+{
+    static struct trace_event events[1000];
+    pthread_t threads[4];
+    FILE *f = tmpfile();
+
+    TEST_ASSERT(trace_start(fileno(f), 10, 0) == 0);
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, tracing_thread, NULL);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    usleep(50 * 1000);  /* Let the drainer free the exited threads' rings. */
+    trace_stop();
+
+    size_t n = read_events(f, events, 1000);
+    TEST_ASSERT(n == 800);
+    int errors = 0;
+    for (size_t i = 0; i < n; ++i) {
+        TEST_ASSERT(events[i].op == op_getattr);
+        if (events[i].type == TRACE_ENTER) {
+            TEST_ASSERT(strcmp(events[i].path, "/dir/file") == 0);
+            /* Each thread's events are written in order. */
+            TEST_ASSERT(i + 1 < n && events[i + 1].type == TRACE_EXIT &&
+                        events[i + 1].tid == events[i].tid &&
+                        events[i + 1].time_ns >= events[i].time_ns);
+        } else if (events[i].result == -2) {
+            ++errors;
+        }
+    }
+    TEST_ASSERT(errors == 200);
+    fclose(f);
+}
+
+static void keeps_end_of_long_paths(void)
+{
+    struct trace_event events[4];
+    char path[100];
+    memset(path, 'a', sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    memcpy(&path[sizeof(path) - 6], "/tail", 5);
+    FILE *f = tmpfile();
+
+    TEST_ASSERT(trace_start(fileno(f), 1000, 0) == 0);
+    trace_enter(op_read, path);
+    trace_enter(op_read, NULL);
+    trace_stop();
+
+    TEST_ASSERT(read_events(f, events, 4) == 2);
+    TEST_ASSERT(strlen(events[0].path) == TRACE_PATH_LEN - 1);
+    TEST_ASSERT(strcmp(events[0].path + TRACE_PATH_LEN - 6, "/tail") == 0);
+    TEST_ASSERT(events[1].path[0] == '\0');
+    fclose(f);
+}
+
+static void drops_events_when_full(void)
+{
+    static struct trace_event events[TRACE_RING_SIZE + 10];
+    FILE *f = tmpfile();
+
+    /* The drainer won't run before trace_stop. */
+    TEST_ASSERT(trace_start(fileno(f), 60 * 1000, 0) == 0);
+    for (int i = 0; i < TRACE_RING_SIZE + 100; ++i) {
+        trace_exit(op_read, i);
+    }
+    trace_stop();
+
+    size_t n = read_events(f, events, TRACE_RING_SIZE + 10);
+    TEST_ASSERT(n == TRACE_RING_SIZE + 1);
+    TEST_ASSERT(events[TRACE_RING_SIZE - 1].result == TRACE_RING_SIZE - 1);
+    TEST_ASSERT(events[TRACE_RING_SIZE].type == TRACE_DROPPED);
+    TEST_ASSERT(events[TRACE_RING_SIZE].result == 100);
+    fclose(f);
+}
+
+static void stops_at_max_size(void)
+{
+    struct trace_event events[20];
+    size_t header_size = sizeof(struct trace_header) + 2 * TRACE_OP_NAME_LEN;
+    size_t max_size = header_size + 10 * sizeof(struct trace_event);
+    FILE *f = tmpfile();
+
+    TEST_ASSERT(trace_start(fileno(f), 60 * 1000, max_size) == 0);
+    for (int i = 0; i < 50; ++i) {
+        trace_exit(op_read, i);
+    }
+    trace_stop();
+
+    /* Room is kept for the final event. */
+    TEST_ASSERT(read_events(f, events, 20) == 10);
+    TEST_ASSERT(events[8].type == TRACE_EXIT && events[8].result == 8);
+    TEST_ASSERT(events[9].type == TRACE_TRUNCATED);
+    TEST_ASSERT(events[9].result == (int64_t)max_size);
+    TEST_ASSERT(ftell(f) == (long)max_size);
+    fclose(f);
+}
+
+static void ignores_events_when_stopped(void)
+{
+    trace_enter(op_read, "/file");
+    trace_exit(op_read, 0);
+    trace_stop();
+}
+
+static void trace_suite(void)
+{
+    op_getattr = trace_register_op("getattr");
+    op_read = trace_register_op("read");
+
+    ignores_events_when_stopped();
+    traces_threads();
+    keeps_end_of_long_paths();
+    drops_events_when_full();
+    stops_at_max_size();
+}
+
+TEST_MAIN(trace_suite)
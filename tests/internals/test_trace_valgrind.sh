@@ -0,0 +1,11 @@
+#!/bin/sh -eu
+if [ ! -x ./test_trace ]; then
+    cd `dirname "$0"`
+fi
+
+if [ -n "`which valgrind`" ]; then
+    valgrind --error-exitcode=100 ./test_trace
+else
+    echo "Warning: valgrind not found. Running without."
+    ./test_trace
+fi
@@ -0,0 +1,143 @@
+#define _XOPEN_SOURCE 700
+
+#include "test_common.h"
+#include "write_behind.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static char file_path[] = "/tmp/bindfs_test_write_behind_XXXXXX";
+
+static off_t file_size(int fd)
+{
+    struct stat st;
+    fstat(fd, &st);
+    return st.st_size;
+}
+
+static void coalesces_adjacent_writes(int fd)
+{
+    TEST_ASSERT(ftruncate(fd, 0) == 0);
+    struct write_behind *wb = write_behind_create(fd, 100);
+    TEST_ASSERT(wb != NULL);
+
+    TEST_ASSERT(write_behind_write(wb, "abc", 3, 0) == 3);
+    TEST_ASSERT(write_behind_write(wb, "def", 3, 3) == 3);
+    TEST_ASSERT(file_size(fd) == 0);
+
+    struct stat st;
+    fstat(fd, &st);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == 6);
+
+    TEST_ASSERT(write_behind_flush(wb) == 0);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == -1);
+
+    char buf[16] = {0};
+    TEST_ASSERT(pread(fd, buf, sizeof(buf), 0) == 6);
+    TEST_ASSERT(strcmp(buf, "abcdef") == 0);
+
+    TEST_ASSERT(write_behind_close(wb) == 0);
+}
+
+static void flushes_before_other_writes(int fd)
+{
+    TEST_ASSERT(ftruncate(fd, 0) == 0);
+    struct write_behind *wb = write_behind_create(fd, 4);
+
+    TEST_ASSERT(write_behind_write(wb, "ab", 2, 0) == 2);
+    TEST_ASSERT(write_behind_write(wb, "xy", 2, 10) == 2);  /* Not adjacent */
+    TEST_ASSERT(file_size(fd) == 2);
+    TEST_ASSERT(write_behind_write(wb, "0123456789", 10, 20) == 10);  /* Too big to buffer */
+    TEST_ASSERT(file_size(fd) == 30);
+
+    TEST_ASSERT(write_behind_close(wb) == 0);
+    char buf[2];
+    TEST_ASSERT(pread(fd, buf, 2, 10) == 2);
+    TEST_ASSERT(memcmp(buf, "xy", 2) == 0);
+}
+
+static void flushes_in_background(int fd)
+{
+    TEST_ASSERT(ftruncate(fd, 0) == 0);
+    TEST_ASSERT(write_behind_start(10) == 0);
+    struct write_behind *wb = write_behind_create(fd, 100);
+
+    TEST_ASSERT(write_behind_write(wb, "abc", 3, 0) == 3);
+    for (int i = 0; i < 100 && file_size(fd) == 0; ++i) {
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    TEST_ASSERT(file_size(fd) == 3);
+
+    TEST_ASSERT(write_behind_close(wb) == 0);
+    write_behind_stop();
+}
+
+static void flushes_all_buffers_of_a_file(int fd)
+{
+    TEST_ASSERT(ftruncate(fd, 0) == 0);
+    int fd2 = open(file_path, O_WRONLY);
+    TEST_ASSERT(fd2 != -1);
+    struct write_behind *wb1 = write_behind_create(fd, 100);
+    struct write_behind *wb2 = write_behind_create(fd2, 100);
+
+    struct stat st;
+    fstat(fd, &st);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == -1);
+    TEST_ASSERT(write_behind_write(wb1, "abc", 3, 0) == 3);
+    TEST_ASSERT(write_behind_write(wb2, "xyz", 3, 10) == 3);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == 13);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino + 1) == -1);
+
+    TEST_ASSERT(write_behind_flush_inode(st.st_dev, st.st_ino) == 0);
+    TEST_ASSERT(file_size(fd) == 13);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == -1);
+
+    TEST_ASSERT(write_behind_write(wb2, "uvw", 3, 20) == 3);
+    TEST_ASSERT(write_behind_close(wb1) == 0);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == 23);
+    TEST_ASSERT(write_behind_close(wb2) == 0);
+    TEST_ASSERT(write_behind_pending_end(st.st_dev, st.st_ino) == -1);
+    TEST_ASSERT(file_size(fd) == 23);
+    close(fd2);
+}
+
+static void reports_deferred_errors(void)
+{
+    int fd = open(file_path, O_RDONLY);
+    TEST_ASSERT(fd != -1);
+    TEST_ASSERT(write_behind_start(10) == 0);
+    struct write_behind *wb = write_behind_create(fd, 100);
+
+    /* Accepted now, fails when flushed in the background. */
+    TEST_ASSERT(write_behind_write(wb, "abc", 3, 0) == 3);
+    write_behind_stop();
+
+    TEST_ASSERT(write_behind_write(wb, "def", 3, 3) == -EBADF);
+    TEST_ASSERT(write_behind_flush(wb) == 0);  /* Reported only once */
+
+    TEST_ASSERT(write_behind_write(wb, "ghi", 3, 6) == 3);
+    TEST_ASSERT(write_behind_close(wb) == -EBADF);
+    close(fd);
+}
+
+static void write_behind_suite(void)
+{
+    int fd = mkstemp(file_path);
+    TEST_ASSERT(fd != -1);
+
+    coalesces_adjacent_writes(fd);
+    flushes_before_other_writes(fd);
+    flushes_in_background(fd);
+    flushes_all_buffers_of_a_file(fd);
+    reports_deferred_errors();
+
+    close(fd);
+    unlink(file_path);
+}
+
+TEST_MAIN(write_behind_suite)
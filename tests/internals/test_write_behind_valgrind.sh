@@ -0,0 +1,11 @@
+#!/bin/sh -eu
+if [ ! -x ./test_write_behind ]; then
+    cd `dirname "$0"`
+fi
+
+if [ -n "`which valgrind`" ]; then
+    valgrind --error-exitcode=100 ./test_write_behind
+else
+    echo "Warning: valgrind not found. Running without."
+    ./test_write_behind
+fi
@@ -39,6 +39,11 @@ $have_fuse_3_readdir_bug = $have_fuse_3 && Proc.new do
   $?.success?
 end.call
 
+$have_fuse_passthrough = $have_fuse_3 && `uname`.strip == 'Linux' && Proc.new do
+  system("pkg-config --atleast-version=3.16 fuse3")
+  $?.success?
+end.call
+
 $have_fuse_29 = !$have_fuse_3 && !$fuse_t && Proc.new do
   v = `pkg-config --modversion fuse`.split('.')
   raise "failed to get FUSE version with pkg-config" if v.size < 2
@@ -859,6 +864,305 @@ root_testenv("", :title => "ioctl not enabled by default", :valgrind => false) d
   assert { `chattr +a mnt/file 2>&1`; !$?.success? }
 end
 
+if $have_fuse_3 && `uname`.strip == 'Linux'
+  testenv("", :title => "copy_file_range") do
+    data = 'abcdefgh' * 100000
+    File.write('src/file1', data)
+
+    # IO.copy_stream uses copy_file_range between regular files on Linux.
+    File.open('mnt/file1') do |src|
+      File.open('mnt/file2', 'w') do |dst|
+        IO.copy_stream(src, dst)
+      end
+    end
+    assert { File.read('src/file2') == data }
+
+    IO.copy_stream('mnt/file1', 'mnt/file3', 1000, 5)
+    assert { File.read('src/file3') == data[5, 1000] }
+  end
+end
+
+if ($have_fuse_29 || $have_fuse_3) && `uname`.strip == 'Linux' && system("which fallocate > /dev/null 2>&1")
+  testenv("", :title => "fallocate") do
+    system("fallocate -l 1M mnt/file1")
+    assert { $?.success? }
+    assert { File.size('src/file1') == 1024*1024 }
+
+    File.write('src/file2', 'x' * 16384)
+    system("fallocate --punch-hole -o 4096 -l 4096 mnt/file2")
+    assert { $?.success? }
+    contents = File.read('src/file2')
+    assert { contents.size == 16384 }
+    assert { contents[0, 4096] == 'x' * 4096 }
+    assert { contents[4096, 4096] == "\0" * 4096 }
+    assert { contents[8192, 8192] == 'x' * 8192 }
+  end
+end
+
+if $have_fuse_3 && `uname`.strip == 'Linux'
+  testenv("", :title => "SEEK_DATA and SEEK_HOLE") do
+    File.open('src/file', 'w') do |f|
+      f.write('x' * 4096)
+      f.seek(1024*1024)
+      f.write('y' * 4096)
+    end
+
+    # Whether holes are reported depends on the source filesystem,
+    # so just check that we match it.
+    [[0, IO::SEEK_HOLE], [0, IO::SEEK_DATA], [8192, IO::SEEK_DATA], [8192, IO::SEEK_HOLE]].each do |offset, whence|
+      expected = File.open('src/file') { |f| f.seek(offset, whence); f.pos }
+      actual = File.open('mnt/file') { |f| f.seek(offset, whence); f.pos }
+      assert { actual == expected }
+    end
+  end
+end
+
+# Falls back to normal I/O if the kernel doesn't support passthrough.
+if $have_fuse_passthrough
+  root_testenv("--passthrough") do
+    File.write('src/file1', 'hello')
+    assert { File.read('mnt/file1') == 'hello' }
+
+    File.write('mnt/file2', 'world')
+    assert { File.read('src/file2') == 'world' }
+
+    File.open('mnt/file1', 'r+') do |f|
+      f.seek(5)
+      f.write(' world')
+    end
+    assert { File.read('src/file1') == 'hello world' }
+    assert { File.size('mnt/file1') == 11 }
+  end
+end
+
+testenv("--max-write=256k --max-read=64k --max-readahead=128k", :title => "request size options") do
+  data = (0...(3 * 1024 * 1024)).map { |i| (i % 251).chr }.join
+  File.write('mnt/file', data)
+  assert { File.read('src/file') == data }
+  assert { File.read('mnt/file') == data }
+end
+
+if `uname`.strip == 'Linux'
+  testenv("--direct-io --multithreaded", :title => "parallel direct writes") do
+    chunk = 64 * 1024
+    File.write('mnt/file', '')
+    threads = (0...8).map do |i|
+      Thread.new do
+        File.open('mnt/file', 'r+') do |f|
+          f.pwrite(i.to_s * chunk, i * chunk)
+        end
+      end
+    end
+    threads.each(&:join)
+
+    expected = (0...8).map { |i| i.to_s * chunk }.join
+    assert { File.read('src/file') == expected }
+  end
+end
+
+if `uname`.strip == 'Linux'
+  testenv("--direct-io-paths=*.log:/streams/* --direct-io-min-size=1M --direct-io-flags=append:sync --keep-cache",
+          :title => "per-file direct I/O policy") do
+    mkdir('src/streams')
+    big = 'x' * (2 * 1024 * 1024)
+    File.write('src/big', big)
+
+    File.write('mnt/a.log', 'log')
+    File.write('mnt/streams/s', 'stream')
+    File.write('mnt/small', 'small')
+    File.open('mnt/a.log', 'a') { |f| f.write(' more') }
+
+    assert { File.read('mnt/a.log') == 'log more' }
+    assert { File.read('mnt/streams/s') == 'stream' }
+    assert { File.read('mnt/small') == 'small' }
+    assert { File.read('mnt/big') == big }
+  end
+end
+
+testenv("--source-readahead=1M") do
+  data = (0...(4 * 1024 * 1024)).map { |i| (i % 253).chr }.join
+  File.write('src/file', data)
+  assert { File.read('mnt/file') == data }
+  File.open('mnt/file') do |f|
+    [3000000, 5, 1234567, 4000000].each do |offset|
+      assert { f.pread(1000, offset) == data[offset, 1000] }
+    end
+  end
+end
+
+testenv("--write-behind=64k") do
+  File.open('mnt/file', 'w') do |f|
+    1000.times { |i| f.write("record #{i}\n") }
+    f.flush
+    expected = (0...1000).map { |i| "record #{i}\n" }.join
+    assert { File.size('mnt/file') == expected.size }
+    assert { File.read('mnt/file') == expected }
+    f.fsync
+    assert { File.read('src/file') == expected }
+  end
+
+  File.write('mnt/file2', 'x' * 200000)
+  assert { File.read('src/file2') == 'x' * 200000 }
+end
+
+testenv("--multithreaded --sync-policy=ignore --sync-policy-rules=*.db=group-commit --sync-interval=5") do
+  File.open('mnt/file', 'w') do |f|
+    f.write('hello')
+    f.fsync
+  end
+  assert { File.read('src/file') == 'hello' }
+
+  threads = (1..4).map do |i|
+    Thread.new do
+      File.open("mnt/file#{i}.db", 'w') do |f|
+        10.times do
+          f.write('x')
+          f.fsync
+        end
+      end
+    end
+  end
+  threads.each(&:join)
+  (1..4).each { |i| assert { File.read("src/file#{i}.db") == 'x' * 10 } }
+
+  File.open('mnt', 'r') { |d| d.fsync }
+end
+
+testenv("--read-rate-per-user=1M --write-rate-per-user=1M") do
+  File.write('mnt/file', 'x' * 100000)
+  assert { File.read('src/file') == 'x' * 100000 }
+  assert { File.read('mnt/file') == 'x' * 100000 }
+end
+
+testenv("--write-rate-per-user=50k --rate-limit-by=gid") do
+  start = Time.now
+  File.write('mnt/file', 'x' * 100000)
+  assert { Time.now - start >= 1.0 }
+  assert { File.read('src/file') == 'x' * 100000 }
+end
+
+testenv("--op-rate=lookup=20:create=1000 --op-rate-per-user=readdir=1000") do
+  start = Time.now
+  40.times { |i| File.exist?("mnt/missing#{i}") }  # Negative lookups aren't cached
+  assert { Time.now - start >= 1.0 }
+  Dir.entries('mnt')
+  mkdir('mnt/dir')
+  assert { File.directory?('src/dir') }
+end
+
+testenv("--read-rate=1M --write-rate=1M --fair-queue --fair-queue-weights=0=2") do
+  threads = (1..4).map do |i|
+    Thread.new do
+      File.write("mnt/file#{i}", 'x' * 100000)
+      File.read("mnt/file#{i}")
+    end
+  end
+  threads.each { |t| assert { t.value == 'x' * 100000 } }
+end
+
+testenv("--read-rate=10k") do
+  File.write('src/file', 'x' * 100000)
+  reader = Thread.new { File.read('mnt/file') }
+  sleep 0.5
+  start = Time.now
+  assert { File.exist?('mnt/file') }
+  touch('mnt/other')
+  assert { Time.now - start < 2 }
+  assert { reader.value == 'x' * 100000 }
+end
+
+testenv("--shared-rate-limit=bindfs-test-#{Process.pid} --shared-read-rate=1M --shared-write-rate=1M") do
+  File.write('mnt/file', 'x' * 100000)
+  assert { File.read('mnt/file') == 'x' * 100000 }
+  assert { File.exist?("/dev/shm/bindfs-bindfs-test-#{Process.pid}") } if File.directory?('/dev/shm')
+  File.unlink("/dev/shm/bindfs-bindfs-test-#{Process.pid}") rescue nil
+end
+
+rate_config = "/tmp/bindfs-test-rate-config-#{Process.pid}"
+File.write(rate_config, "# Daytime\nwrite-rate = 50k\n")
+testenv("--write-rate=10M --rate-burst=0 --rate-config=#{rate_config}") do |bindfs_pid|
+  start = Time.now
+  File.write('mnt/file', 'x' * 100000)
+  assert { Time.now - start >= 1.0 }
+
+  File.write(rate_config, "write-rate=10M\nrate-burst=0.5\n")
+  Process.kill("SIGUSR2", bindfs_pid)
+  sleep 0.5
+  start = Time.now
+  File.write('mnt/file', 'x' * 100000)
+  assert { Time.now - start < 1.0 }
+
+  # A broken file is ignored.
+  File.write(rate_config, "write-rate=fast\n")
+  Process.kill("SIGUSR2", bindfs_pid)
+  sleep 0.5
+  File.write('mnt/file', 'x' * 100000)
+  assert { File.read('src/file') == 'x' * 100000 }
+end
+File.unlink(rate_config)
+
+testenv("--latency-target=50") do
+  File.write('mnt/file', 'x' * 1000000)
+  assert { File.read('mnt/file') == 'x' * 1000000 }
+  assert { File.read('src/file') == 'x' * 1000000 }
+end
+
+testenv("--stats") do
+  touch('src/file')
+  File.read('mnt/file')
+  assert { Dir.entries('mnt').sort == ['.', '..', 'file'] }
+  assert { Dir.entries('mnt/.bindfs').sort == ['.', '..', 'stats'] }
+  stats = File.read('mnt/.bindfs/stats')
+  assert { stats =~ /^op\s+count\s+errors/ }
+  assert { stats =~ /^read\s+\d+\s+0\s/ }
+  assert_exception(Errno::EACCES) { File.open('mnt/.bindfs/stats', 'w') }
+end
+
+testenv("--metrics=test-#{Process.pid}") do
+  File.write('mnt/file', 'x' * 10000)
+  assert { File.read('mnt/file') == 'x' * 10000 }
+  out = `../../src/bindfs-stat -o test-#{Process.pid}`
+  assert { $?.success? }
+  assert { out =~ /ops\/s\s+errors\/s\s+rkB\/s\s+wkB\/s/ }
+  assert { out =~ /^write\s/ }
+end
+
+testenv("--accounting=uid") do
+  File.write('mnt/file', 'x' * 10000)
+  assert { File.read('mnt/file') == 'x' * 10000 }
+  assert { Dir.entries('mnt/.bindfs').sort == ['.', '..', 'accounting'] }
+  assert { File.stat('mnt/.bindfs/accounting').mode & 0777 == 0400 }
+  accounting = File.read('mnt/.bindfs/accounting')
+  assert { accounting =~ /^uid\s+ops\s+time_ms\s+bytes_read\s+bytes_written/ }
+  assert { accounting =~ /^#{Process.uid}\s+\d+\s+[\d.]+\s+\d+\s+10000$/ }
+  assert_exception(Errno::EACCES) { File.open('mnt/.bindfs/accounting', 'w') }
+  File.open('mnt/.bindfs', 'r') { |d| d.fsync }
+  assert { File.exist?('mnt/.bindfs/accounting') }
+end
+
+trace_file = Tempfile.new('bindfs-trace')
+trace_file.close
+testenv("--trace=#{trace_file.path}") do
+  touch('mnt/file')
+  assert { File.read('mnt/file') == '' }
+  assert_exception(Errno::ENOENT) { File.stat('mnt/nonexistent') }
+  sleep 0.5  # Let the trace be written out
+  out = `../../src/bindfs-trace #{Shellwords.escape(trace_file.path)}`
+  assert { $?.success? }
+  assert { out =~ /> getattr \/file$/ }
+  assert { out =~ /< getattr = -2 \(No such file or directory\)/ }
+end
+
+testenv("--trace=#{trace_file.path} --trace-max-size=4k") do
+  100.times { |i| assert_exception(Errno::ENOENT) { File.stat("mnt/nonexistent#{i}") } }
+  sleep 0.5  # Let the trace be written out
+  assert { File.size(trace_file.path) <= 4096 }
+  out = `../../src/bindfs-trace #{Shellwords.escape(trace_file.path)}`
+  assert { $?.success? }
+  assert { out.lines.last =~ /trace stopped at its maximum size of 4096 bytes/ }
+end
+trace_file.unlink
+
 # Issue #41
 testenv("", :title => "reading directory with rewind") do
   touch('mnt/file1')